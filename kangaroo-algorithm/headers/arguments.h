@@ -2,6 +2,7 @@
 #define KANGAROO___ARGUMENTS_H
 
 #include <string>
+#include <vector>
 
 struct ParsedArgs {
     long r;
@@ -17,6 +18,41 @@ struct ParsedArgs {
     bool allow_write_table;
     int secret_size;
     std::string secret_path;
+    // Group parameters: a file and per-value overrides, empty if not provided
+    std::string group_params_path;
+    std::string group_p;
+    std::string group_g;
+    std::string group_order;
+    std::string group_curve;
+    // Negation map for curve groups, on unless disabled
+    bool no_negation_map;
+    // Step kernel override, empty for the automatic selection
+    std::string kernel;
+    // Format of a generated table file: "mapped" (default, a version 3 file mapped on load) or "packed"
+    std::string table_format;
+    // Lookup structure for solving: "buckets" (default, the frozen table) or "perfect" (perfect hash index)
+    std::string table_index;
+    // Number of lookups of the table benchmark, which replaces solving, 0 to solve
+    long table_benchmark;
+    // Bits per key of the lookup prefilter, 0 for none
+    int table_filter_bits;
+    // Fingerprint and log bits of the compressed table, 0 to keep the full table
+    int table_key_bits;
+    int table_log_bits;
+    // Seconds between checkpoints of table generation, 0 for none
+    long checkpoint_interval;
+    // Continue table generation from its checkpoint, if there is one
+    bool resume;
+    // Index of this machine's shard of a table generated on several machines, 0 for a whole table
+    long table_shard;
+    // Table and shard files to merge into the table path instead of solving
+    std::vector<std::string> merge_tables;
+    // Generation over several processes: the address a generating run takes workers' points on, and the coordinator
+    // address of a worker, which only walks
+    std::string coordinator_address;
+    std::string worker_address;
+    // Megabytes the generation table may take before it is spilled to disk, 0 for no limit
+    long memory_budget;
 };
 
 ParsedArgs parse_args(int argc, char *argv[]);
@@ -0,0 +1,198 @@
+#ifndef KANGAROO___CURVE_H
+#define KANGAROO___CURVE_H
+
+#include <gmpxx.h>
+#include <cstdint>
+#include <string>
+
+#include "../headers/field.h"
+
+// Short Weierstrass curve y^2 = x^3 + a * x + b over F_p (p of at most 256 bits) with a generator of prime order n.
+struct CurveParams {
+    std::string name;
+    mpz_class p;
+    mpz_class a;
+    mpz_class b;
+    mpz_class gx;
+    mpz_class gy;
+    mpz_class n;
+};
+
+// Built-in curves: "secp256k1" and "ed25519". The latter is Wei25519, the short Weierstrass form of Curve25519, with
+// the image of the Ed25519 base point as the generator: the group is the prime-order group of Ed25519 and Ristretto255,
+// so discrete logs carry over once points are mapped to the Weierstrass form. Returns nullptr for unknown names.
+const CurveParams* find_curve(const std::string& name);
+
+// Point with canonical integer coordinates, used outside the walk.
+struct AffinePoint {
+    mpz_class x;
+    mpz_class y;
+    bool infinity;
+};
+
+bool on_curve(const CurveParams& curve, const AffinePoint& P);
+
+AffinePoint curve_add(const CurveParams& curve, const AffinePoint& P, const AffinePoint& Q);
+
+// e * P, e may be negative
+AffinePoint curve_mul(const CurveParams& curve, const AffinePoint& P, const mpz_class& e);
+
+// Points travel through the driver, the table and the logs as integers x * 2^256 + y, the point at infinity as 0.
+mpz_class encode_point(const AffinePoint& P);
+
+AffinePoint decode_point(const mpz_class& encoded);
+
+// Curve group for the walk, over a field backend with fully reduced 4-limb elements in a representation that is
+// linear in the residue (Fp256, PseudoMersenneField<4>). mul() is the group operation, so the walk code written for
+// multiplicative groups runs unchanged; label() is taken from x only, so P and -P get the same jump and the same
+// distinguished property. With the negation map the walk moves on the classes {P, -P}, see canonical().
+template <typename Field>
+struct CurveGroup {
+    typedef typename Field::Element FieldElement;
+
+    struct Element {
+        FieldElement x;
+        FieldElement y;
+        bool infinity;
+    };
+
+    Field F;
+    CurveParams curve;
+    FieldElement a;
+    FieldElement one;
+    bool negation_map;
+
+    CurveGroup(const CurveParams& curve, bool negation_map)
+            : F(curve.p), curve(curve), a(F.from_mpz(curve.a)), one(F.from_mpz(1)), negation_map(negation_map) {}
+
+    std::string name() const {
+        return curve.name + " over " + F.name() + (negation_map ? " with negation map" : "");
+    }
+
+    // Affine addition for any pair of points, including doubling and the point at infinity.
+    void mul(Element &r, const Element &P, const Element &Q) const {
+        if (P.infinity) { r = Q; return; }
+        if (Q.infinity) { r = P; return; }
+
+        FieldElement lambda, t;
+        if (equal(P.x, Q.x)) {
+            FieldElement y_sum;
+            add(y_sum, P.y, Q.y);
+            if (is_zero(y_sum)) {
+                r.infinity = true;
+                return;
+            }
+
+            // Doubling: lambda = (3 * x^2 + a) / (2 * y)
+            FieldElement x2;
+            F.mul(x2, P.x, P.x);
+            add(t, x2, x2);
+            add(t, t, x2);
+            add(t, t, a);
+            inv(lambda, y_sum);
+            F.mul(lambda, lambda, t);
+        } else {
+            sub(t, Q.x, P.x);
+            inv(lambda, t);
+            sub(t, Q.y, P.y);
+            F.mul(lambda, lambda, t);
+        }
+
+        add_with_slope(r, P, Q, lambda);
+    }
+
+    // r = P + Q for the slope lambda of the line through P and Q. r may alias P.
+    void add_with_slope(Element &r, const Element &P, const Element &Q, const FieldElement &lambda) const {
+        FieldElement x3, y3;
+        F.mul(x3, lambda, lambda);
+        sub(x3, x3, P.x);
+        sub(x3, x3, Q.x);
+        sub(y3, P.x, x3);
+        F.mul(y3, y3, lambda);
+        sub(y3, y3, P.y);
+        r.x = x3;
+        r.y = y3;
+        r.infinity = false;
+    }
+
+    // The representative of {P, -P} is the point whose y has an even representation. Replaces P by it and returns
+    // true if that negated P.
+    bool canonical(Element &P) const {
+        if (P.infinity || !(P.y.v[0] & 1)) return false;
+        sub(P.y, zero(), P.y);
+        return true;
+    }
+
+    Element from_mpz(const mpz_class &x) const {
+        AffinePoint point = decode_point(x);
+        Element result;
+        result.infinity = point.infinity;
+        result.x = F.from_mpz(point.infinity ? 0 : point.x);
+        result.y = F.from_mpz(point.infinity ? 0 : point.y);
+        return result;
+    }
+
+    mpz_class to_mpz(const Element &P) const {
+        return encode_point(AffinePoint{F.to_mpz(P.x), F.to_mpz(P.y), P.infinity});
+    }
+
+    static uint64_t label(const Element &P) { return Field::label(P.x); }
+
+    // Field helpers on the 4-limb representation
+    static FieldElement zero() { return FieldElement{{0, 0, 0, 0}}; }
+
+    static bool is_zero(const FieldElement &x) { return !(x.v[0] | x.v[1] | x.v[2] | x.v[3]); }
+
+    static bool equal(const FieldElement &x, const FieldElement &y) {
+        return !((x.v[0] ^ y.v[0]) | (x.v[1] ^ y.v[1]) | (x.v[2] ^ y.v[2]) | (x.v[3] ^ y.v[3]));
+    }
+
+    void add(FieldElement &r, const FieldElement &x, const FieldElement &y) const {
+        typedef unsigned __int128 u128;
+
+        uint64_t t[4], s[4], carry = 0, borrow = 0;
+        for (int j = 0; j < 4; ++j) {
+            u128 c = (u128) x.v[j] + y.v[j] + carry;
+            t[j] = (uint64_t) c;
+            carry = (uint64_t) (c >> 64);
+        }
+        for (int j = 0; j < 4; ++j) {
+            u128 d = (u128) t[j] - F.p[j] - borrow;
+            s[j] = (uint64_t) d;
+            borrow = (uint64_t) (d >> 64) & 1;
+        }
+        // Keep the sum only when it is below p: the subtraction borrowed and the addition did not carry
+        const uint64_t keep = 0 - (borrow & (carry ^ 1));
+        for (int j = 0; j < 4; ++j) r.v[j] = (t[j] & keep) | (s[j] & ~keep);
+    }
+
+    void sub(FieldElement &r, const FieldElement &x, const FieldElement &y) const {
+        typedef unsigned __int128 u128;
+
+        uint64_t t[4], borrow = 0, carry = 0;
+        for (int j = 0; j < 4; ++j) {
+            u128 d = (u128) x.v[j] - y.v[j] - borrow;
+            t[j] = (uint64_t) d;
+            borrow = (uint64_t) (d >> 64) & 1;
+        }
+        // Add p back if the difference is negative
+        const uint64_t mask = 0 - borrow;
+        for (int j = 0; j < 4; ++j) {
+            u128 c = (u128) t[j] + (F.p[j] & mask) + carry;
+            r.v[j] = (uint64_t) c;
+            carry = (uint64_t) (c >> 64);
+        }
+    }
+
+    // r = x^-1 for x != 0. Goes through GMP, the walk calls it once per batch of lanes.
+    void inv(FieldElement &r, const FieldElement &x) const {
+        mpz_class value = F.to_mpz(x);
+        mpz_invert(value.get_mpz_t(), value.get_mpz_t(), curve.p.get_mpz_t());
+        r = F.from_mpz(value);
+    }
+};
+
+extern template struct CurveGroup<Fp256>;
+extern template struct CurveGroup<PseudoMersenneField<4>>;
+
+#endif //KANGAROO___CURVE_H
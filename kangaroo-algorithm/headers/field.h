@@ -0,0 +1,321 @@
+#ifndef KANGAROO___FIELD_H
+#define KANGAROO___FIELD_H
+
+#include <gmpxx.h>
+#include <cstdint>
+#include <string>
+#include <variant>
+
+// Field backends used by the walk. Every backend exposes the same interface:
+//  - Element: representation of a residue mod p that the walk keeps for its whole lifetime;
+//  - mul(r, a, b): r = a * b mod p in that representation;
+//  - from_mpz / to_mpz: conversion from and to the canonical residue;
+//  - label(x): low 64 bits of the representation, used by hash() and distinguished().
+// The walk is a deterministic function of the representation, so a table is only valid for the backend it was
+// generated with.
+
+// Fallback backend that keeps the plain GMP arithmetic for moduli no fixed-width backend supports.
+struct MpzField {
+    typedef mpz_class Element;
+
+    mpz_class p;
+
+    explicit MpzField(const mpz_class &p) : p(p) {}
+
+    static const char* name() { return "mpz"; }
+
+    void mul(Element &r, const Element &a, const Element &b) const {
+        mpz_mul(r.get_mpz_t(), a.get_mpz_t(), b.get_mpz_t());
+        mpz_tdiv_r(r.get_mpz_t(), r.get_mpz_t(), p.get_mpz_t());
+    }
+
+    Element from_mpz(const mpz_class &x) const { return x % p; }
+
+    mpz_class to_mpz(const Element &x) const { return x; }
+
+    static uint64_t label(const Element &x) { return mpz_getlimbn(x.get_mpz_t(), 0); }
+};
+
+// Montgomery form field for moduli up to 256 bits. An element x is stored as x * 2^256 mod p in 4 x 64-bit limbs
+// (least significant first), so multiplication needs no division and no heap allocations.
+struct Fp256 {
+    struct Element {
+        uint64_t v[4];
+    };
+
+    uint64_t p[4];
+    // -p^-1 mod 2^64
+    uint64_t n0;
+    // 2^512 mod p, used to move values into the Montgomery form
+    Element r2;
+    Element one;
+
+    explicit Fp256(const mpz_class &modulus);
+
+    static const char* name() { return "fp256-montgomery"; }
+
+    // Montgomery multiplication (CIOS): r = a * b * 2^-256 mod p. Inputs must be fully reduced, so is the output.
+    void mul(Element &r, const Element &a, const Element &b) const {
+        typedef unsigned __int128 u128;
+
+        uint64_t t0 = 0, t1 = 0, t2 = 0, t3 = 0, t4 = 0;
+        for (int i = 0; i < 4; ++i) {
+            const uint64_t ai = a.v[i];
+            u128 c;
+
+            c = (u128) ai * b.v[0] + t0; t0 = (uint64_t) c;
+            c = (u128) ai * b.v[1] + t1 + (uint64_t) (c >> 64); t1 = (uint64_t) c;
+            c = (u128) ai * b.v[2] + t2 + (uint64_t) (c >> 64); t2 = (uint64_t) c;
+            c = (u128) ai * b.v[3] + t3 + (uint64_t) (c >> 64); t3 = (uint64_t) c;
+            c = (u128) t4 + (uint64_t) (c >> 64); t4 = (uint64_t) c;
+            uint64_t t5 = (uint64_t) (c >> 64);
+
+            const uint64_t m = t0 * n0;
+            c = (u128) m * p[0] + t0;
+            c = (u128) m * p[1] + t1 + (uint64_t) (c >> 64); t0 = (uint64_t) c;
+            c = (u128) m * p[2] + t2 + (uint64_t) (c >> 64); t1 = (uint64_t) c;
+            c = (u128) m * p[3] + t3 + (uint64_t) (c >> 64); t2 = (uint64_t) c;
+            c = (u128) t4 + (uint64_t) (c >> 64); t3 = (uint64_t) c;
+            t4 = t5 + (uint64_t) (c >> 64);
+        }
+
+        // The result is below 2p, one conditional subtraction brings it into [0, p)
+        u128 d;
+        uint64_t s0, s1, s2, s3, borrow;
+        d = (u128) t0 - p[0]; s0 = (uint64_t) d; borrow = (uint64_t) (d >> 64) & 1;
+        d = (u128) t1 - p[1] - borrow; s1 = (uint64_t) d; borrow = (uint64_t) (d >> 64) & 1;
+        d = (u128) t2 - p[2] - borrow; s2 = (uint64_t) d; borrow = (uint64_t) (d >> 64) & 1;
+        d = (u128) t3 - p[3] - borrow; s3 = (uint64_t) d; borrow = (uint64_t) (d >> 64) & 1;
+        // Keep t only when t < p, i.e. the subtraction borrowed and there is no carry limb
+        const uint64_t keep = 0 - (uint64_t) (borrow & (t4 == 0));
+        r.v[0] = (t0 & keep) | (s0 & ~keep);
+        r.v[1] = (t1 & keep) | (s1 & ~keep);
+        r.v[2] = (t2 & keep) | (s2 & ~keep);
+        r.v[3] = (t3 & keep) | (s3 & ~keep);
+    }
+
+    Element from_mpz(const mpz_class &x) const;
+
+    mpz_class to_mpz(const Element &x) const;
+
+    static uint64_t label(const Element &x) { return x.v[0]; }
+};
+
+// Fp256 for Montgomery-friendly moduli (p = -1 mod 2^64, e.g. NIST P-256). Then n0 = 1 and every reduction round
+// takes its multiplier straight from the low limb, which removes one multiplication from the round's critical path.
+// The representation is the same as in Fp256.
+struct Fp256Friendly : Fp256 {
+    using Fp256::Fp256;
+
+    static const char* name() { return "fp256-montgomery-friendly"; }
+
+    void mul(Element &r, const Element &a, const Element &b) const {
+        typedef unsigned __int128 u128;
+
+        uint64_t t0 = 0, t1 = 0, t2 = 0, t3 = 0, t4 = 0;
+        for (int i = 0; i < 4; ++i) {
+            const uint64_t ai = a.v[i];
+            u128 c;
+
+            c = (u128) ai * b.v[0] + t0; t0 = (uint64_t) c;
+            c = (u128) ai * b.v[1] + t1 + (uint64_t) (c >> 64); t1 = (uint64_t) c;
+            c = (u128) ai * b.v[2] + t2 + (uint64_t) (c >> 64); t2 = (uint64_t) c;
+            c = (u128) ai * b.v[3] + t3 + (uint64_t) (c >> 64); t3 = (uint64_t) c;
+            c = (u128) t4 + (uint64_t) (c >> 64); t4 = (uint64_t) c;
+            uint64_t t5 = (uint64_t) (c >> 64);
+
+            // m * p[0] + t0 = m * 2^64 exactly, so the low column only contributes a carry of m
+            const uint64_t m = t0;
+            c = (u128) m * p[1] + t1 + m; t0 = (uint64_t) c;
+            c = (u128) m * p[2] + t2 + (uint64_t) (c >> 64); t1 = (uint64_t) c;
+            c = (u128) m * p[3] + t3 + (uint64_t) (c >> 64); t2 = (uint64_t) c;
+            c = (u128) t4 + (uint64_t) (c >> 64); t3 = (uint64_t) c;
+            t4 = t5 + (uint64_t) (c >> 64);
+        }
+
+        u128 d;
+        uint64_t s0, s1, s2, s3, borrow;
+        d = (u128) t0 - p[0]; s0 = (uint64_t) d; borrow = (uint64_t) (d >> 64) & 1;
+        d = (u128) t1 - p[1] - borrow; s1 = (uint64_t) d; borrow = (uint64_t) (d >> 64) & 1;
+        d = (u128) t2 - p[2] - borrow; s2 = (uint64_t) d; borrow = (uint64_t) (d >> 64) & 1;
+        d = (u128) t3 - p[3] - borrow; s3 = (uint64_t) d; borrow = (uint64_t) (d >> 64) & 1;
+        const uint64_t keep = 0 - (uint64_t) (borrow & (t4 == 0));
+        r.v[0] = (t0 & keep) | (s0 & ~keep);
+        r.v[1] = (t1 & keep) | (s1 & ~keep);
+        r.v[2] = (t2 & keep) | (s2 & ~keep);
+        r.v[3] = (t3 & keep) | (s3 & ~keep);
+    }
+};
+
+// Field for pseudo-Mersenne primes p = 2^k - c (e.g. 2^255 - 19, secp256k1) with 64 * (N - 1) < k <= 64 * N and
+// c * 2^(64 * N - k) < 2^64. Elements are kept as canonical residues in N limbs. A product is reduced by folding its
+// upper half back with 2^(64 * N) = c * 2^(64 * N - k) (mod p), which needs no shifts and is cheaper than a
+// Montgomery reduction.
+template <int N>
+struct PseudoMersenneField {
+    struct Element {
+        uint64_t v[N];
+    };
+
+    uint64_t p[N];
+    int k;
+    uint64_t c;
+    // c * 2^(64 * N - k) = 2^(64 * N) mod p
+    uint64_t c_fold;
+
+    explicit PseudoMersenneField(const mpz_class &modulus);
+
+    // Returns true if the modulus has the form this backend supports.
+    static bool supports(const mpz_class &modulus);
+
+    static const char* name();
+
+    void mul(Element &r, const Element &a, const Element &b) const {
+        typedef unsigned __int128 u128;
+
+        uint64_t t[2 * N];
+        uint64_t carry = 0;
+        if constexpr (N > 4) {
+            // Wide operands go through the GMP assembly kernels
+            static_assert(sizeof(mp_limb_t) == sizeof(uint64_t), "PseudoMersenneField expects 64-bit GMP limbs");
+            mp_limb_t* tl = reinterpret_cast<mp_limb_t*>(t);
+            mpn_mul_n(tl, reinterpret_cast<const mp_limb_t*>(a.v), reinterpret_cast<const mp_limb_t*>(b.v), N);
+            carry = mpn_addmul_1(tl, tl + N, N, c_fold);
+        } else {
+            for (int i = 0; i < N; ++i) {
+                uint64_t row_carry = 0;
+                for (int j = 0; j < N; ++j) {
+                    u128 x = (u128) a.v[i] * b.v[j] + (i == 0 ? 0 : t[i + j]) + row_carry;
+                    t[i + j] = (uint64_t) x;
+                    row_carry = (uint64_t) (x >> 64);
+                }
+                t[i + N] = row_carry;
+            }
+
+            // Fold the upper half: the result fits in N limbs plus a top limb of at most c_fold
+            for (int j = 0; j < N; ++j) {
+                u128 x = (u128) t[j + N] * c_fold + t[j] + carry;
+                t[j] = (uint64_t) x;
+                carry = (uint64_t) (x >> 64);
+            }
+        }
+
+        // Fold the top limb, then the at most one bit that overflows from it
+        for (int round = 0; round < 2; ++round) {
+            u128 x = (u128) carry * c_fold + t[0];
+            t[0] = (uint64_t) x;
+            carry = (uint64_t) (x >> 64);
+            for (int j = 1; j < N; ++j) {
+                x = (u128) t[j] + carry;
+                t[j] = (uint64_t) x;
+                carry = (uint64_t) (x >> 64);
+            }
+        }
+
+        // t < 2^(64 * N). Fold the bits above k once more, which leaves less than 2^k + c * 2^(64 * N - k) < 2p.
+        if (k < 64 * N) {
+            const int shift = k - 64 * (N - 1);
+            uint64_t high = t[N - 1] >> shift;
+            t[N - 1] &= (uint64_t(1) << shift) - 1;
+            u128 x = (u128) high * c + t[0];
+            t[0] = (uint64_t) x;
+            carry = (uint64_t) (x >> 64);
+            for (int j = 1; j < N; ++j) {
+                x = (u128) t[j] + carry;
+                t[j] = (uint64_t) x;
+                carry = (uint64_t) (x >> 64);
+            }
+        }
+
+        u128 d;
+        uint64_t s[N], borrow = 0;
+        for (int j = 0; j < N; ++j) {
+            d = (u128) t[j] - p[j] - borrow;
+            s[j] = (uint64_t) d;
+            borrow = (uint64_t) (d >> 64) & 1;
+        }
+        const uint64_t keep = 0 - borrow;
+        for (int j = 0; j < N; ++j) r.v[j] = (t[j] & keep) | (s[j] & ~keep);
+    }
+
+    Element from_mpz(const mpz_class &x) const;
+
+    mpz_class to_mpz(const Element &x) const;
+
+    static uint64_t label(const Element &x) { return x.v[0]; }
+};
+
+extern template struct PseudoMersenneField<4>;
+extern template struct PseudoMersenneField<8>;
+
+// Montgomery form field over N 64-bit limbs for moduli of up to 64 * N bits (ElGamal-style groups). The product is
+// computed with mpn_mul_n into a per-thread scratch buffer and reduced word by word with mpn_addmul_1, so the walk
+// runs without heap allocations.
+template <int N>
+struct MontField {
+    static_assert(GMP_LIMB_BITS == 64, "MontField expects 64-bit GMP limbs");
+
+    struct Element {
+        mp_limb_t v[N];
+    };
+
+    mp_limb_t p[N];
+    // -p^-1 mod 2^64
+    mp_limb_t n0;
+    // 2^(128 * N) mod p, used to move values into the Montgomery form
+    Element r2;
+    Element one;
+
+    explicit MontField(const mpz_class &modulus);
+
+    static const char* name();
+
+    // r = a * b * 2^(-64 * N) mod p. Inputs must be fully reduced, so is the output.
+    void mul(Element &r, const Element &a, const Element &b) const {
+        static thread_local mp_limb_t scratch[2 * N];
+
+        if (&a == &b) {
+            mpn_sqr(scratch, a.v, N);
+        } else {
+            mpn_mul_n(scratch, a.v, b.v, N);
+        }
+
+        // Word-by-word reduction. Limb k is zero after its round, so it keeps that round's carry which is added to
+        // the upper half at the end.
+        for (int k = 0; k < N; ++k) {
+            const mp_limb_t m = scratch[k] * n0;
+            scratch[k] = mpn_addmul_1(scratch + k, p, N, m);
+        }
+
+        const mp_limb_t carry = mpn_add_n(r.v, scratch + N, scratch, N);
+        if (carry || mpn_cmp(r.v, p, N) >= 0) {
+            mpn_sub_n(r.v, r.v, p, N);
+        }
+    }
+
+    Element from_mpz(const mpz_class &x) const;
+
+    mpz_class to_mpz(const Element &x) const;
+
+    static uint64_t label(const Element &x) { return x.v[0]; }
+};
+
+extern template struct MontField<8>;
+extern template struct MontField<16>;
+extern template struct MontField<24>;
+extern template struct MontField<32>;
+extern template struct MontField<48>;
+extern template struct MontField<64>;
+
+typedef std::variant<MpzField, Fp256, Fp256Friendly, PseudoMersenneField<4>, PseudoMersenneField<8>, MontField<8>, MontField<16>, MontField<24>, MontField<32>, MontField<48>,
+        MontField<64>> FieldBackend;
+
+// Picks the fastest backend that supports the modulus. Special-form primes get a dedicated reduction: pseudo-Mersenne
+// primes up to 512 bits use PseudoMersenneField and Montgomery-friendly primes up to 256 bits use Fp256Friendly.
+// Otherwise Fp256 is used up to 256 bits, the smallest MontField instantiation that fits up to 4096 bits and MpzField
+// above that.
+FieldBackend make_field(const mpz_class &p);
+
+std::string field_name(const FieldBackend &field);
+
+#endif //KANGAROO___FIELD_H
@@ -0,0 +1,82 @@
+#ifndef KANGAROO___FIXED_BASE_H
+#define KANGAROO___FIXED_BASE_H
+
+#include <gmpxx.h>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+#include "../headers/int128.h"
+
+// Precomputed powers of a fixed base g for exponents of up to max_bits bits, split into windows of window_bits bits:
+// powers[k << window_bits | d] = g^(d * 2^(k * window_bits)). g^e is then the product of one entry per window, with no
+// squarings. Elements are canonical integers and mul is the group operation on them.
+struct FixedBasePowers {
+    int window_bits = 0;
+    int windows = 0;
+    mpz_class identity;
+    std::vector<mpz_class> powers;
+
+    FixedBasePowers() = default;
+
+    FixedBasePowers(const mpz_class &g, const mpz_class &identity,
+                    const std::function<mpz_class(const mpz_class&, const mpz_class&)> &mul, int max_bits,
+                    int window_bits = 8);
+};
+
+// FixedBasePowers in the representation of a field backend.
+template <typename Field>
+class FixedBase {
+public:
+    typedef typename Field::Element Element;
+
+    FixedBase(const Field &F, const FixedBasePowers &base)
+            : F(F), window_bits(base.window_bits), windows(base.windows), one(F.from_mpz(base.identity)) {
+        powers.reserve(base.powers.size());
+        for (const mpz_class &x : base.powers) powers.push_back(F.from_mpz(x));
+    }
+
+    // g^e for e below 2^(windows * window_bits)
+    Element power(uint128_t e) const {
+        const uint64_t limbs[2] = {(uint64_t) e, (uint64_t) (e >> 64)};
+        return power_limbs(limbs, 2);
+    }
+
+    Element power(const mpz_class &e) const {
+        std::vector<uint64_t> limbs(mpz_size(e.get_mpz_t()));
+        for (size_t k = 0; k < limbs.size(); ++k) limbs[k] = mpz_getlimbn(e.get_mpz_t(), k);
+        return power_limbs(limbs.data(), limbs.size());
+    }
+
+private:
+    Element power_limbs(const uint64_t* limbs, size_t size) const {
+        const uint64_t mask = (uint64_t(1) << window_bits) - 1;
+        Element result = one;
+        bool first = true;
+        for (int k = 0; k < windows; ++k) {
+            const size_t pos = (size_t) k * window_bits, word = pos / 64, shift = pos % 64;
+            if (word >= size) break;
+            uint64_t digit = limbs[word] >> shift;
+            if (shift + window_bits > 64 && word + 1 < size) digit |= limbs[word + 1] << (64 - shift);
+            digit &= mask;
+            if (!digit) continue;
+
+            const Element &entry = powers[(size_t) k << window_bits | digit];
+            if (first) {
+                result = entry;
+                first = false;
+            } else {
+                F.mul(result, result, entry);
+            }
+        }
+        return result;
+    }
+
+    const Field F;
+    int window_bits;
+    int windows;
+    Element one;
+    std::vector<Element> powers;
+};
+
+#endif //KANGAROO___FIXED_BASE_H
@@ -0,0 +1,24 @@
+#ifndef KANGAROO___GROUP_H
+#define KANGAROO___GROUP_H
+
+#include <gmpxx.h>
+#include <string>
+#include <variant>
+
+#include "../headers/field.h"
+#include "../headers/curve.h"
+#include "../headers/params.h"
+
+// Backends of the walk: the field backends for multiplicative groups mod p and the curve groups. All of them expose
+// the interface described in field.h, with mul() being the group operation.
+typedef std::variant<MpzField, Fp256, Fp256Friendly, PseudoMersenneField<4>, PseudoMersenneField<8>, MontField<8>,
+        MontField<16>, MontField<24>, MontField<32>, MontField<48>, MontField<64>, CurveGroup<Fp256>,
+        CurveGroup<PseudoMersenneField<4>>> GroupBackend;
+
+// Curve groups run over PseudoMersenneField<4> when p has that form (secp256k1, ed25519) and over Fp256 otherwise,
+// multiplicative groups over the field picked by make_field().
+GroupBackend make_group_backend(const GroupParams &params);
+
+std::string backend_name(const GroupBackend &backend);
+
+#endif //KANGAROO___GROUP_H
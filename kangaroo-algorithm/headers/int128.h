@@ -0,0 +1,29 @@
+#ifndef KANGAROO___INT128_H
+#define KANGAROO___INT128_H
+
+#include <gmpxx.h>
+#include <cstdint>
+
+typedef unsigned __int128 uint128_t;
+typedef __int128 int128_t;
+
+// Converts 0 <= x < 2^128 to a native integer. Higher bits are dropped.
+inline uint128_t mpz_to_u128(const mpz_class &x) {
+    uint64_t words[2] = {0, 0};
+    mpz_class low = x & ((mpz_class(1) << 128) - 1);
+    mpz_export(words, nullptr, -1, sizeof(uint64_t), 0, 0, low.get_mpz_t());
+    return ((uint128_t) words[1] << 64) | words[0];
+}
+
+inline mpz_class u128_to_mpz(uint128_t x) {
+    uint64_t words[2] = {(uint64_t) x, (uint64_t) (x >> 64)};
+    mpz_class result;
+    mpz_import(result.get_mpz_t(), 2, -1, sizeof(uint64_t), 0, 0, words);
+    return result;
+}
+
+inline mpz_class i128_to_mpz(int128_t x) {
+    return x < 0 ? mpz_class(-u128_to_mpz(0 - (uint128_t) x)) : u128_to_mpz((uint128_t) x);
+}
+
+#endif //KANGAROO___INT128_H
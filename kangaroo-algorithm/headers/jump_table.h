@@ -0,0 +1,33 @@
+#ifndef KANGAROO___JUMP_TABLE_H
+#define KANGAROO___JUMP_TABLE_H
+
+#include <gmpxx.h>
+#include <vector>
+
+#include "../headers/int128.h"
+
+// One jump of the walk: the element in the field representation and its exponent side by side. Entries are 64-byte
+// aligned, so for the 256-bit backends a jump is exactly one cache line and a table of R <= 256 jumps stays in L1.
+template <typename Element>
+struct alignas(64) Jump {
+    Element s;
+    uint128_t slog;
+};
+
+// Contiguous jump table, indexed by hash()
+template <typename Element>
+using JumpTable = std::vector<Jump<Element>>;
+
+// Builds the table from the canonical s and slog arrays. Exponents are truncated to 128 bits, walks that need wider
+// distances use slog itself.
+template <typename Field>
+JumpTable<typename Field::Element> make_jump_table(const Field &F, const mpz_class* s, const mpz_class* slog, long R) {
+    JumpTable<typename Field::Element> table(R);
+    for (long h = 0; h < R; ++h) {
+        table[h].s = F.from_mpz(s[h]);
+        table[h].slog = mpz_to_u128(slog[h]);
+    }
+    return table;
+}
+
+#endif //KANGAROO___JUMP_TABLE_H
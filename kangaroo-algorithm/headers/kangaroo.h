@@ -9,14 +9,29 @@
 #include <unordered_map>
 #include <map>
 #include <atomic>
+#include <chrono>
+#include <functional>
+#include <string>
+#include <vector>
 
 #include "../headers/table.h"
+#include "../headers/group.h"
+#include "../headers/params.h"
+#include "../headers/int128.h"
+#include "../headers/fixed_base.h"
+#include "../headers/jump_table.h"
 
 struct PreprocessingResult {
     long long numsteps;
-    std::unordered_map<std::string, long long> distinguishedCounter;
-
-    PreprocessingResult(long long numsteps, std::unordered_map<std::string, long long> distinguishedCounter) : numsteps(numsteps), distinguishedCounter(distinguishedCounter) {}
+    // Number of distinguished points by the number of walks that reached them, in power-of-two ranges keyed by their
+    // lower end: all generated points and the ones kept for the table
+    std::map<long long, long long> hitHistogram;
+    std::map<long long, long long> keptHistogram;
+    long long candidates;
+
+    PreprocessingResult(long long numsteps, std::map<long long, long long> hitHistogram,
+                        std::map<long long, long long> keptHistogram, long long candidates)
+            : numsteps(numsteps), hitHistogram(hitHistogram), keptHistogram(keptHistogram), candidates(candidates) {}
 };
 
 struct MainResult {
@@ -36,14 +51,58 @@ public:
     double i;
     double m;
     long R;
-    mpz_class* slog;
-    mpz_class* s;
+    mpz_class* slog = nullptr;
+    mpz_class* s = nullptr;
     mpz_class g;
     mpz_class p;
     mpz_class l;
-
-    // Parallelization with map
-    TableDataMap tableMap;
+    // Order of g, zero if unknown
+    mpz_class order;
+
+    // Arithmetic backend of the walk, picked from the group parameters
+    GroupBackend backend;
+    // Curve group: elements are points encoded by encode_point() and power() is the scalar multiplication
+    bool elliptic;
+    CurveParams curve;
+    bool negation_map;
+    // Width of the native walk distances (64 or 128) set by init_s()
+    int distance_bits = 0;
+    // Powers of g for the walks' start points, built by init_s()
+    FixedBasePowers g_powers;
+
+    // Distinguished points of the precomputation, moved to frozen_table by freeze_table() before solving
+    DistinguishedTable table;
+    FrozenTable frozen_table;
+    // Replaces frozen_table for solving when compress_table() was called
+    CompressedTable compressed_table;
+    bool compressed = false;
+    // Prefilter in front of the table lookups, set by filter_table()
+    TableFilter table_filter;
+    bool filtered = false;
+    // Replaces frozen_table for solving when index_table() was called
+    PerfectHashTable perfect_table;
+    bool perfect_index = false;
+    // Range of the logs of table entries, set by init_s()
+    mpz_class table_log_min;
+    mpz_class table_log_max;
+
+    // Generation writes a checkpoint of the table to checkpoint_path every checkpoint_interval seconds, if not 0
+    std::string checkpoint_path;
+    long checkpoint_interval = 0;
+    // Counters of the generation, continued from a checkpoint by resume_table()
+    GenerationCheckpoint generation;
+    // Bytes the generation table may take, 0 for no limit. Beyond it the table is spilled to the files spill_prefix
+    // followed by the run number, to be merged by merge_tables().
+    size_t memory_budget = 0;
+    std::string spill_prefix;
+    // Shard of a table generated on several machines, 0 for a whole table. Seeds the start points, so shards take
+    // different walks, and keeps all candidates for merge_tables().
+    long shard = 0;
+    // Address ("host:port" or "unix:path") where the generation takes distinguished points from workers, empty for none
+    std::string coordinator_address;
+    // Set on workers: the walks pass their distinguished points here instead of inserting them, until stop_generation
+    std::function<void(uint64_t, int128_t)> point_sink;
+    std::atomic<bool> stop_generation{false};
 
     KangarooAlgorithm(
             long n,
@@ -52,24 +111,105 @@ public:
             double i,
             double m,
             long r,
-            mpz_class p
+            const GroupParams& group
     );
 
-    int distinguished(const mpz_class &w);
+    // Both take the label of a walk element (see field.h)
+    int distinguished(uint64_t w);
 
-    int hash(const mpz_class &w);
+    int hash(uint64_t w);
 
     mpz_class power(const mpz_class &g, const mpz_class &e);
 
+    // Group operation and neutral element on the integer encoding of group elements
+    mpz_class group_mul(const mpz_class &a, const mpz_class &b);
+
+    mpz_class identity();
+
     void init_s();
 
+    // Builds s, the distance width, the range of table logs and g_powers from slog, called by init_s()
+    void init_jumps();
+
+    // Parameters the table depends on, stored with it
+    TableParams table_params();
+
+    // Describes the first parameter of a loaded table that differs from this run's, empty if the table fits
+    std::string table_params_mismatch(const TableParams& params);
+
+    // Takes over the jump table a table was generated with
+    void restore_jumps(const std::vector<uint128_t>& jump_logs);
+
+    // Name of the lane kernel the walks run on
+    std::string lane_kernel_name();
+
+    // Size of one entry of the walks' jump table in the active field representation
+    size_t jump_entry_size();
+
+    // Builds the read-only table the solving threads look up and releases the generation table
+    void freeze_table();
+
+    // Builds a prefilter over the frozen table's fingerprints, before the table is indexed or compressed
+    void filter_table(int bits_per_key);
+
+    // Builds the perfect hash index over the frozen table and solves with it
+    void index_table();
+
+    // Looks a fingerprint up in the frozen table or its perfect hash index
+    bool find_in_table(uint64_t key, int128_t& log) const {
+        return perfect_index ? perfect_table.find(key, log) : frozen_table.find(key, log);
+    }
+
+    // Keeps key_bits fingerprint bits and log_bits log bits per entry of the frozen table, see CompressedTable
+    void compress_table(int key_bits, int log_bits);
+
+    // Number of candidate logs a match in the compressed table is checked against
+    mpz_class compressed_candidates();
+
+    // Finds log_g(h) from a walk that met a compressed entry with log low modulo 2^log_bits: walks the candidate table
+    // logs one group operation apart and compares with h. sum, start and negated describe the walk as in solve_lanes.
+    bool recover_log(const mpz_class& h, uint128_t low, bool negated, const mpz_class& sum, const mpz_class& start,
+                     mpz_class& log);
+
+    // Generates M * N distinguished points when m > 1 and keeps the N that most walks reached (Bernstein-Lange)
     PreprocessingResult generate_table_parallel_map();
 
-    void parallel_loop_map(std::unordered_map<std::string, long long>& distinguishedCounter,
-                       int& tabledone, gmp_randclass& ra, int i, int W, mpz_class g,
-                       mpz_class* slog, mpz_class* s, mpz_class p, int thread_num);
+    // Entries of a spilled run under the memory budget, 0 without one
+    size_t spill_run_size() const;
+
+    std::string spill_path(uint64_t run) const;
+
+    // Writes the table as the next spilled run and empties it
+    void spill_run();
+
+    // Runs as a worker of the coordinator at address: takes over its parameters and jump table, walks with all threads
+    // and streams the distinguished points to it until its table is full. Returns the number of steps.
+    long long run_worker(const std::string& address);
+
+    // Continues generation from a checkpoint of this run's parameters, with its jump table. Returns an empty string or
+    // why the checkpoint cannot be used.
+    std::string resume_table(const std::string& path);
+
+    template <typename Field>
+    void parallel_loop_map(std::atomic<long long>& numsteps, size_t limit, uint64_t seed, const Field& F,
+                           int thread_num, std::chrono::steady_clock::time_point deadline);
+
+    // Walks from start points drawn with seed until the table holds limit entries or the deadline has passed
+    template <typename Field>
+    void table_lanes(const Field& F, const JumpTable<typename Field::Element>& jumps, size_t limit,
+                     std::atomic<long long>& numsteps, uint64_t seed,
+                     std::chrono::steady_clock::time_point deadline);
+
+
+    template <typename Field>
+    void solve_dlp_map_parallel_function(const Field& F, mpz_class h, MainResult& final_result, std::atomic<bool>& stopFlag, uint64_t seed, int j) ;
+
+    template <typename Field>
+    void solve_lanes(const Field& F, const JumpTable<typename Field::Element>& jumps, const mpz_class& h,
+                     MainResult& final_result, std::atomic<bool>& stopFlag, uint64_t seed);
 
-    void solve_dlp_map_parallel_function( mpz_class h, MainResult& final_result, std::atomic<bool>& stopFlag, gmp_randclass& ra, int j) ;
+    void publish_solution(MainResult& final_result, std::atomic<bool>& stopFlag, long numsteps, const mpz_class& log,
+                          int iter_num);
 
     MainResult solve_dlp_map_parallel(mpz_class h);
 
@@ -0,0 +1,322 @@
+#ifndef KANGAROO___LANES_H
+#define KANGAROO___LANES_H
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include "../headers/field.h"
+#include "../headers/curve.h"
+#include "../headers/int128.h"
+#include "../headers/jump_table.h"
+
+// Jump table handed to the lane kernels.
+template <typename Element>
+struct LaneJumps {
+    const Jump<Element>* table;
+    long R;
+    long W;
+    // Every jump sum of a walk fits 64 bits, so the kernels may keep 64-bit sums
+    bool narrow = false;
+};
+
+// A lane kernel advances several independent walks in lockstep. Every lane holds the current element, the sum of the
+// exponents of the jumps made since the lane was set and the number of those jumps. run() steps all lanes until at
+// least one of them sits on a distinguished point or has made max_steps jumps and returns the mask of such lanes; the
+// caller handles them and sets them to new walks before calling run() again. A lane that is set to a distinguished
+// point is reported by the next run() without stepping.
+// Kernels that walk on classes {P, -P} may negate a lane's element; then lane_negated() tells whether the element is
+// -start + sum * g rather than start + sum * g, with sum being lane_jumps() read as a signed 128-bit integer.
+template <typename Element>
+class LaneKernel {
+public:
+    virtual ~LaneKernel() = default;
+
+    virtual const char* name() const = 0;
+
+    virtual int lanes() const = 0;
+
+    virtual void set_lane(int lane, const Element &w) = 0;
+
+    virtual Element get_lane(int lane) const = 0;
+
+    virtual uint128_t lane_jumps(int lane) const = 0;
+
+    virtual long lane_steps(int lane) const = 0;
+
+    virtual bool lane_negated(int) const { return false; }
+
+    virtual uint64_t run(long max_steps) = 0;
+};
+
+// Portable kernel: interleaves LANES walks so the independent multiplications overlap in the pipeline.
+template <typename Field, int LANES = 4>
+class ScalarLaneKernel : public LaneKernel<typename Field::Element> {
+public:
+    typedef typename Field::Element Element;
+
+    ScalarLaneKernel(const Field &F, const LaneJumps<Element> &jumps, const char* kernel_name = "generic")
+            : F(F), jumps(jumps), kernel_name(kernel_name) {
+        for (int lane = 0; lane < LANES; ++lane) {
+            w[lane] = F.from_mpz(1);
+            sums[lane] = 0;
+            steps[lane] = 0;
+        }
+    }
+
+    const char* name() const override { return kernel_name; }
+
+    int lanes() const override { return LANES; }
+
+    void set_lane(int lane, const Element &x) override {
+        w[lane] = x;
+        sums[lane] = 0;
+        steps[lane] = 0;
+    }
+
+    Element get_lane(int lane) const override { return w[lane]; }
+
+    uint128_t lane_jumps(int lane) const override { return sums[lane]; }
+
+    long lane_steps(int lane) const override { return steps[lane]; }
+
+    uint64_t run(long max_steps) override {
+        const uint64_t d_mask = jumps.W - 1;
+        const uint64_t r_mask = jumps.R - 1;
+
+        while (true) {
+            uint64_t labels[LANES];
+            uint64_t stopped = 0;
+            for (int lane = 0; lane < LANES; ++lane) {
+                labels[lane] = F.label(w[lane]);
+                if (!(labels[lane] & d_mask) || steps[lane] >= max_steps) stopped |= uint64_t(1) << lane;
+            }
+            if (stopped) return stopped;
+
+            for (int lane = 0; lane < LANES; ++lane) {
+                const Jump<Element> &jump = jumps.table[labels[lane] & r_mask];
+                F.mul(w[lane], w[lane], jump.s);
+                sums[lane] += jump.slog;
+                ++steps[lane];
+            }
+        }
+    }
+
+private:
+    const Field F;
+    LaneJumps<Element> jumps;
+    const char* kernel_name;
+    Element w[LANES];
+    uint128_t sums[LANES];
+    long steps[LANES];
+};
+
+template <typename Field>
+struct is_curve_group : std::false_type {};
+
+template <typename Field>
+struct is_curve_group<CurveGroup<Field>> : std::true_type {};
+
+// Curve kernel: LANES walks make their affine additions together, so the LANES inversions of the slopes' denominators
+// become one inversion and 3 * (LANES - 1) multiplications (Montgomery's simultaneous inversion). With the negation
+// map every new point is replaced by the representative of its class, which negates the lane's start and sum.
+// A walk that jumps to -P and then takes the same jump again returns to P. The kernel therefore looks ahead: when the
+// jump from P would give a negated point with the same hash, it tries the next jump of the table from P instead, so
+// the walk stays a function of the point and such 2-cycles are kept out of it.
+template <typename Curve, int LANES = 64>
+class EcLaneKernel : public LaneKernel<typename Curve::Element> {
+public:
+    typedef typename Curve::Element Element;
+    typedef typename Curve::FieldElement FieldElement;
+
+    EcLaneKernel(const Curve &C, const LaneJumps<Element> &jumps) : C(C), jumps(jumps) {
+        for (int lane = 0; lane < LANES; ++lane) set_lane(lane, C.from_mpz(0));
+    }
+
+    const char* name() const override { return "ec-batched-affine"; }
+
+    int lanes() const override { return LANES; }
+
+    void set_lane(int lane, const Element &x) override {
+        w[lane] = x;
+        negated[lane] = C.negation_map && C.canonical(w[lane]);
+        sums[lane] = 0;
+        steps[lane] = 0;
+        skipped[lane] = 0;
+    }
+
+    Element get_lane(int lane) const override { return w[lane]; }
+
+    uint128_t lane_jumps(int lane) const override { return sums[lane]; }
+
+    long lane_steps(int lane) const override { return steps[lane]; }
+
+    bool lane_negated(int lane) const override { return negated[lane]; }
+
+    uint64_t run(long max_steps) override {
+        const uint64_t d_mask = jumps.W - 1;
+        const uint64_t r_mask = jumps.R - 1;
+
+        while (true) {
+            uint64_t stopped = 0;
+            for (int lane = 0; lane < LANES; ++lane) {
+                const uint64_t label = C.label(w[lane]);
+                if (!(label & d_mask) || steps[lane] >= max_steps) stopped |= uint64_t(1) << lane;
+
+                jump[lane] = (label + skipped[lane]) & r_mask;
+            }
+            if (stopped) return stopped;
+
+            // Denominators x_S - x_P and their prefix products; pairs that need the generic addition get 1
+            FieldElement acc = C.one;
+            for (int lane = 0; lane < LANES; ++lane) {
+                const Element &S = jumps.table[jump[lane]].s;
+                C.sub(denominator[lane], S.x, w[lane].x);
+                special[lane] = w[lane].infinity || S.infinity || C.is_zero(denominator[lane]);
+                if (special[lane]) denominator[lane] = C.one;
+                prefix[lane] = acc;
+                C.F.mul(acc, acc, denominator[lane]);
+            }
+
+            FieldElement inverse;
+            C.inv(inverse, acc);
+
+            for (int lane = LANES - 1; lane >= 0; --lane) {
+                const Jump<Element> &entry = jumps.table[jump[lane]];
+                Element next;
+
+                if (special[lane]) {
+                    C.mul(next, w[lane], entry.s);
+                } else {
+                    // inverse = (d_0 ... d_lane)^-1, so the lane's slope denominator inverse is inverse * prefix
+                    FieldElement lambda, t;
+                    C.F.mul(t, inverse, prefix[lane]);
+                    C.F.mul(inverse, inverse, denominator[lane]);
+                    C.sub(lambda, entry.s.y, w[lane].y);
+                    C.F.mul(lambda, lambda, t);
+                    C.add_with_slope(next, w[lane], entry.s, lambda);
+                }
+
+                const bool flip = C.negation_map && C.canonical(next);
+                // A rejected jump leaves the lane on its point, the next round tries the following jump
+                if (flip && (C.label(next) & r_mask) == (uint64_t) jump[lane] && skipped[lane] < jumps.R - 1) {
+                    ++skipped[lane];
+                    continue;
+                }
+
+                w[lane] = next;
+                sums[lane] += entry.slog;
+                if (flip) {
+                    negated[lane] = !negated[lane];
+                    sums[lane] = 0 - sums[lane];
+                }
+                skipped[lane] = 0;
+                ++steps[lane];
+            }
+        }
+    }
+
+private:
+    const Curve C;
+    LaneJumps<Element> jumps;
+    Element w[LANES];
+    uint128_t sums[LANES];
+    long steps[LANES];
+    bool negated[LANES];
+    long skipped[LANES];
+    long jump[LANES];
+    bool special[LANES];
+    FieldElement denominator[LANES];
+    FieldElement prefix[LANES];
+};
+
+// Jump table and modulus of an Fp256 field in radix 2^bits for the SIMD kernels, which work with limbs * bits = 260.
+// Jump elements are multiplied by 2^(bits * limbs - 256), so a Montgomery multiplication by 2^(-bits * limbs) in the
+// kernel gives exactly Fp256::mul and the walks match the other kernels.
+struct RadixJumpTable {
+    int bits;
+    int limbs;
+    long R;
+    // Limb j of jump h is s[j * R + h]
+    std::vector<uint64_t> s;
+    std::vector<uint64_t> slog_lo;
+    std::vector<uint64_t> slog_hi;
+    // Copy of LaneJumps::narrow: slog_hi is all zeros and the sums never carry into the high half
+    bool narrow;
+    std::vector<uint64_t> p;
+    // 2^(bits * limbs) - p, added to subtract p without signed shifts
+    std::vector<uint64_t> q;
+    // -p^-1 mod 2^bits
+    uint64_t n0;
+
+    RadixJumpTable(const Fp256 &F, const LaneJumps<Fp256::Element> &jumps, int bits, int limbs);
+};
+
+// Splits a fully reduced element into limbs of the given width, writing limb j to out[j * stride].
+void to_radix(const Fp256::Element &x, int bits, int limbs, uint64_t* out, int stride);
+
+// Inverse of to_radix for normalized limbs.
+Fp256::Element from_radix(const uint64_t* in, int bits, int limbs, int stride);
+
+// Fp256 with the multiplication compiled for BMI2 and ADX: MULX leaves the flags alone, so the product and the
+// reduction rows run as ADCX/ADOX carry chains. Only for CPUs with both extensions.
+struct Fp256Mulx : Fp256 {
+    explicit Fp256Mulx(const Fp256 &F) : Fp256(F) {}
+
+    void mul(Element &r, const Element &a, const Element &b) const;
+};
+
+// Step kernels for Fp256 based fields. All of them give the same walks.
+enum KernelKind {
+    KERNEL_GENERIC,
+    KERNEL_MULX,
+    KERNEL_AVX2,
+    KERNEL_AVX512,
+};
+
+// Name used in logs and in the --kernel option.
+const char* kernel_kind_name(KernelKind kind);
+
+// Checks the CPU (cpuid, and xgetbv for the vector register state) for the instructions the kernel needs.
+bool cpu_supports_kernel(KernelKind kind);
+
+// Selects the kernel once, before any walk runs: the fastest supported one, or the one named by the override
+// ("generic", "mulx", "avx2", "avx512"). Throws std::invalid_argument for unknown or unsupported overrides.
+KernelKind select_kernel(const std::string &override_name);
+
+// The kernel chosen by select_kernel(); the fastest supported one if it was not called.
+KernelKind selected_kernel();
+
+// SIMD kernels for the 256-bit Montgomery representation. They return nullptr when the CPU lacks the instructions.
+std::unique_ptr<LaneKernel<Fp256::Element>> make_avx2_lane_kernel(const Fp256 &F, const LaneJumps<Fp256::Element> &jumps);
+
+std::unique_ptr<LaneKernel<Fp256::Element>> make_ifma_lane_kernel(const Fp256 &F, const LaneJumps<Fp256::Element> &jumps);
+
+// Creates the selected kernel for Fp256 based fields and the batched kernel for curve groups, the rest use the portable
+// kernel.
+template <typename Field>
+std::unique_ptr<LaneKernel<typename Field::Element>> make_lane_kernel(const Field &F, const LaneJumps<typename Field::Element> &jumps) {
+    if constexpr (is_curve_group<Field>::value) {
+        return std::unique_ptr<LaneKernel<typename Field::Element>>(new EcLaneKernel<Field>(F, jumps));
+    } else if constexpr (std::is_base_of<Fp256, Field>::value) {
+        switch (selected_kernel()) {
+            case KERNEL_AVX512:
+                if (auto kernel = make_ifma_lane_kernel(F, jumps)) return kernel;
+                break;
+            case KERNEL_AVX2:
+                if (auto kernel = make_avx2_lane_kernel(F, jumps)) return kernel;
+                break;
+            case KERNEL_MULX:
+                return std::unique_ptr<LaneKernel<Fp256::Element>>(
+                        new ScalarLaneKernel<Fp256Mulx>(Fp256Mulx(F), jumps, kernel_kind_name(KERNEL_MULX)));
+            default:
+                break;
+        }
+    }
+
+    return std::unique_ptr<LaneKernel<typename Field::Element>>(new ScalarLaneKernel<Field>(F, jumps));
+}
+
+#endif //KANGAROO___LANES_H
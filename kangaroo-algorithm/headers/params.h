@@ -0,0 +1,37 @@
+#ifndef KANGAROO___PARAMS_H
+#define KANGAROO___PARAMS_H
+
+#include <gmpxx.h>
+#include <string>
+
+#include "../headers/curve.h"
+
+// Parameters of the group the discrete logarithms are solved in. A zero g means that the generator is derived from p
+// and the secret size, a zero order means that the order of g is unknown.
+// For a curve group, curve is the curve's name ("custom" for explicit parameters), a and b are its coefficients, g is
+// the generator encoded by encode_point() and order is its (prime) order.
+struct GroupParams {
+    mpz_class p;
+    mpz_class g;
+    mpz_class order;
+    std::string curve;
+    mpz_class a;
+    mpz_class b;
+    // Walk on the classes {P, -P} of a curve group
+    bool negation_map = true;
+};
+
+// Parameters of a built-in curve (see find_curve()), throws std::invalid_argument for unknown names.
+GroupParams curve_group_params(const std::string& name);
+
+CurveParams group_curve(const GroupParams& params);
+
+// Reads group parameters from a text file with one "name = value" pair per line (names: p, g, order; curve for a
+// built-in curve, or a, b, gx, gy for a custom one). Values are decimal or 0x-prefixed hexadecimal, lines starting
+// with '#' are comments.
+GroupParams read_group_params(const std::string& path);
+
+// Checks that the parameters describe a usable group and throws std::invalid_argument otherwise.
+void validate_group_params(const GroupParams& params);
+
+#endif //KANGAROO___PARAMS_H
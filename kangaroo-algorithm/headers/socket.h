@@ -0,0 +1,37 @@
+#ifndef KANGAROO___SOCKET_H
+#define KANGAROO___SOCKET_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Stream sockets between a table generation coordinator and its workers. Addresses are "host:port" for TCP, with an
+// empty host to listen on all interfaces, or "unix:path" for a Unix socket. Both throw std::runtime_error.
+int listen_on(const std::string& address);
+
+// Closes a listening socket and removes the file of a Unix socket
+void close_listener(int fd, const std::string& address);
+
+int connect_to(const std::string& address);
+
+// Whole buffers, false once the connection is closed or broken
+bool send_all(int fd, const void* data, size_t size);
+
+bool receive_all(int fd, void* data, size_t size);
+
+// Sent by the coordinator to a worker that connects: params_bytes bytes of serialized TableParams follow, the seed is
+// the worker's for its start points. Once the table is full the coordinator sends one byte, and the worker sends its
+// last batch and closes the connection.
+struct WorkerHello {
+    uint64_t params_bytes;
+    uint64_t seed;
+};
+
+// Sent by workers: count TableEntry records of distinguished points follow, steps is the number of steps the walks
+// took since the previous batch.
+struct PointBatchHeader {
+    uint64_t count;
+    uint64_t steps;
+};
+
+#endif //KANGAROO___SOCKET_H
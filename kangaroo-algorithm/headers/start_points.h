@@ -0,0 +1,67 @@
+#ifndef KANGAROO___START_POINTS_H
+#define KANGAROO___START_POINTS_H
+
+#include <gmpxx.h>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+#include "../headers/fixed_base.h"
+#include "../headers/int128.h"
+
+// Start points of walks, base * g^e with e in [0, 2^bits). Only the first one costs an exponentiation: every next
+// one is the previous one times g^r for r picked from a small random set, with e tracked additively, and a step
+// past 2^bits is wrapped around by g^(-2^bits). A start point then costs one or two multiplications.
+template <typename Field>
+class StartPoints {
+public:
+    typedef typename Field::Element Element;
+
+    // Number of precomputed offsets g^r
+    static const int OFFSETS = 64;
+
+    // bits must be below 128 and wrap must be g^(-2^bits); seed makes the sequences of different threads independent
+    StartPoints(const Field &F, const FixedBase<Field> &g_f, const Element &base, const Element &wrap, int bits,
+                uint64_t seed)
+            : F(F), bound((uint128_t) 1 << bits), rng(seed), wrap(wrap) {
+        for (int k = 0; k < OFFSETS; ++k) {
+            r.push_back(random_exponent());
+            offsets.push_back(g_f.power(r.back()));
+        }
+
+        e = random_exponent();
+        w = g_f.power(e);
+        F.mul(w, w, base);
+    }
+
+    // Moves to the next start point and returns it with its exponent
+    const Element& next(uint128_t &exponent) {
+        const int k = (int) (rng() % OFFSETS);
+        F.mul(w, w, offsets[k]);
+        e += r[k];
+        if (e >= bound) {
+            F.mul(w, w, wrap);
+            e -= bound;
+        }
+
+        exponent = e;
+        return w;
+    }
+
+private:
+    uint128_t random_exponent() {
+        uint128_t x = ((uint128_t) rng() << 64) | rng();
+        return x & (bound - 1);
+    }
+
+    const Field &F;
+    uint128_t bound;
+    std::mt19937_64 rng;
+    std::vector<uint128_t> r;
+    std::vector<Element> offsets;
+    const Element wrap;
+    Element w;
+    uint128_t e;
+};
+
+#endif //KANGAROO___START_POINTS_H
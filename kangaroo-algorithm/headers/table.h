@@ -2,26 +2,417 @@
 #define KANGAROO___TABLE_H
 
 #include <gmpxx.h>
-#include <fstream>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <future>
+#include <map>
+#include <memory>
 #include <string>
 #include <vector>
-#include <unordered_map>
 
-struct TableEntryMap {
-    mpz_class log;
+#include "../headers/int128.h"
 
-    void writeToFile(std::ofstream& outFile) const;
+// 64-bit fingerprint of a group element given by its integer encoding (residue or encoded point). Mixes all limbs, so
+// it does not depend on the representation the walk used and stays uniform although distinguished points share their
+// low bits. Never 0, which marks empty slots.
+uint64_t point_fingerprint(const mpz_class& x);
 
-    void readFromFile(std::ifstream& inFile);
+// One slot: the fingerprint and the signed 128-bit log of the distinguished point, stored inline.
+struct TableEntry {
+    uint64_t key;
+    uint64_t log_lo;
+    uint64_t log_hi;
+
+    int128_t log() const { return (int128_t) (((uint128_t) log_hi << 64) | log_lo); }
+};
+
+// Parameters a table was generated with. A table is only valid for the same group, interval, W and jump table, so
+// table files carry them; a run that loads a table checks them and takes over its jump table.
+struct TableParams {
+    long R = 0;
+    long W = 0;
+    int secret_size = 0;
+    bool negation_map = false;
+    // Hexadecimal p, g and order of g (0 if unknown), the curve name (empty for residues) and the walks' backend
+    std::string p;
+    std::string g;
+    std::string order;
+    std::string curve;
+    std::string backend;
+    // Logs of the jumps
+    std::vector<uint128_t> slog;
+
+    std::string serialize() const;
+
+    // Reads serialized parameters, returns false if they are malformed
+    bool parse(const char* data, size_t size);
+};
+
+// Sequential writer of table files: data is gathered in 4 MiB blocks aligned to 4096 bytes, and every full block is
+// written by a background thread while the next one fills, so encoding and I/O overlap.
+struct BlockWriter {
+    explicit BlockWriter(const std::string& path);
+
+    ~BlockWriter();
+
+    BlockWriter(const BlockWriter&) = delete;
+
+    BlockWriter& operator=(const BlockWriter&) = delete;
+
+    bool is_open() const { return fd >= 0; }
+
+    void write(const void* data, size_t size) {
+        if (size <= BLOCK_SIZE - used) {
+            std::memcpy(current + used, data, size);
+            used += size;
+            return;
+        }
+        write_blocks(data, size);
+    }
+
+    // Writes the rest, syncs the file to disk if asked to and closes it. False if any write failed.
+    bool close(bool sync = false);
+
+private:
+    static const size_t BLOCK_SIZE = 4 << 20;
+
+    int fd = -1;
+    char* blocks[2] = {nullptr, nullptr};
+    char* current = nullptr;
+    size_t used = 0;
+    std::future<bool> pending;
+    bool failed = false;
+
+    void write_blocks(const void* data, size_t size);
+
+    // Hands the current block to the background thread once the previous one is written
+    void submit();
+};
+
+// Generation counters saved with a checkpoint of the table and the parameters the table belongs to.
+struct GenerationCheckpoint {
+    long long numsteps = 0;
+    // Number of generation runs that added to the table, the next run draws other start points
+    uint64_t runs = 0;
+    // Runs spilled to disk under a memory budget and their entries, not counting the table
+    uint64_t spilled_runs = 0;
+    uint64_t spilled_entries = 0;
+    TableParams params;
+};
+
+// Checkpoint file of a table under generation: this header, count records of a key, its log and its hits, then
+// params_bytes bytes of serialized TableParams. Integers are little-endian. Shard files, the candidates of one machine
+// for merge_tables(), are checkpoints with the records in key order.
+struct CheckpointFileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t sorted;
+    uint64_t count;
+    uint64_t slots;
+    int64_t numsteps;
+    uint64_t runs;
+    uint64_t spilled_runs;
+    uint64_t spilled_entries;
+    uint64_t params_bytes;
+};
+
+static_assert(sizeof(CheckpointFileHeader) == 72, "the checkpoint file header is 72 bytes");
+
+struct CheckpointRecord {
+    uint64_t key;
+    uint64_t log_lo;
+    uint64_t log_hi;
+    uint32_t hits;
+    uint32_t unused;
 };
 
-struct TableDataMap {
-    std::unordered_map<std::string, TableEntryMap> tableMap;
+static_assert(sizeof(CheckpointRecord) == 32, "checkpoint records are 32 bytes");
+
+// Distinguished points table: open addressing with linear probing over a power-of-two array of slots, kept at most
+// half full.
+struct DistinguishedTable {
+    std::vector<TableEntry> slots;
+    std::atomic<size_t> count{0};
+    // Number of inserts of each slot's key, counted when not empty, see count_hits()
+    std::vector<uint32_t> hits;
+
+    // Makes room for n entries without growing
+    void reserve(size_t n);
+
+    // Starts counting hits
+    void count_hits() { hits.assign(slots.size(), 0); }
+
+    // Inserts the entry unless the key is present, returns whether it was inserted
+    bool insert(uint64_t key, int128_t log);
+
+    // Insert-if-absent that may run in many threads at once: slots are claimed by a compare-and-swap on the key and the
+    // entry count, which never exceeds limit, is taken before the slot. Needs reserve(limit) first, never grows. Logs
+    // are complete once all inserting threads are joined. Hits are counted with atomic increments, also for keys
+    // found present.
+    bool insert_concurrent(uint64_t key, int128_t log, size_t limit);
+
+    // Keeps the n entries with the most hits
+    void keep_most_hit(size_t n);
+
+    // Looks the key up, sets log and returns true if it is present
+    bool find(uint64_t key, int128_t& log) const;
+
+    size_t size() const { return count; }
+
+    size_t memory_bytes() const { return slots.size() * sizeof(TableEntry); }
+
+    // Drops all entries and the slots' memory
+    void clear();
+
+    // Saves the entries, their hits and the state to a temporary file that is synced and then renamed to path, so an
+    // interruption leaves the previous checkpoint intact. Only while no thread inserts. Sorted checkpoints are shards.
+    bool writeCheckpoint(std::string path, const GenerationCheckpoint& state, bool sorted = false) const;
+
+    // Replaces the table by a checkpoint, hits included, and reads its state
+    bool readCheckpoint(std::string path, GenerationCheckpoint& state);
+
+private:
+    // Slot of the key, or the empty slot where it would go
+    size_t probe(uint64_t key) const;
+};
+
+// Table file, version 3. The file is the image of a FrozenTable and is mapped as is: this header, then the sorted
+// keys, their logs, the bucket offsets and the serialized TableParams, each section 64-byte aligned. Integers are
+// little-endian.
+struct TableFileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t bucket_bits;
+    uint64_t count;
+    uint64_t keys_offset;
+    uint64_t logs_offset;
+    uint64_t offsets_offset;
+    uint64_t size;
+    uint64_t params_offset;
+};
+
+static_assert(sizeof(TableFileHeader) == 64, "the table file header is 64 bytes");
+
+// Packed table file for storage and transfer. After this header come the chunk starts, the low key bits, the high key
+// bits and the logs, each as the given number of 64-bit words, then params_bytes bytes of serialized TableParams. The
+// sorted keys are Elias-Fano coded: the low low_bits bits of every key are packed, the rest is a bit vector with a bit
+// set at high part + index for every key. The logs are packed as log_bits-bit offsets from the smallest log. Every
+// 2^chunk_bits keys the position of the key's bit in the high bits is stored, so chunks are decoded in parallel.
+struct PackedTableHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t low_bits;
+    uint64_t count;
+    uint32_t log_bits;
+    uint32_t chunk_bits;
+    uint64_t log_min_lo;
+    uint64_t log_min_hi;
+    uint64_t chunk_words;
+    uint64_t low_words;
+    uint64_t high_words;
+    uint64_t log_words;
+    uint64_t params_bytes;
+};
+
+static_assert(sizeof(PackedTableHeader) == 88, "the packed table file header is 88 bytes");
+
+// Immutable table for the solving threads, built from a DistinguishedTable once it is complete or mapped from a
+// table file. Keys are sorted with their logs in a parallel array, and an offset array over the top bits of the keys
+// points to the run of keys of each bucket, about one key per bucket. A lookup reads one offset and one short run of
+// keys; nothing is written, so any number of threads query it without locks.
+struct FrozenTable {
+    // The file image, in memory or mapped, shared by copies
+    std::shared_ptr<const void> image;
+    size_t image_size = 0;
+    bool mapped = false;
+
+    const uint64_t* keys = nullptr;
+    const int128_t* logs = nullptr;
+    const uint64_t* offsets = nullptr;
+    size_t count = 0;
+    int bucket_bits = 0;
+    TableParams params;
 
-    bool writeToFile(std::string path);
+    FrozenTable() = default;
 
+    FrozenTable(const DistinguishedTable& table, const TableParams& params);
+
+    bool find(uint64_t key, int128_t& log) const;
+
+    size_t size() const { return count; }
+
+    size_t memory_bytes() const { return image_size; }
+
+    bool writeToFile(std::string path) const;
+
+    // Writes the table as a packed file, see PackedTableHeader
+    bool writePacked(std::string path) const;
+
+    // Maps a table file read-only and shared, so the pages are loaded on first use and shared with other processes
+    // mapping the same table. Packed files are decoded instead, by all hardware threads.
     bool readFromFile(std::string path);
+
+private:
+    // Takes the image and reads its parameters, returns false if they are malformed
+    bool attach(std::shared_ptr<const void> data, size_t size);
+
+    // Allocates and attaches an image for n entries, whose keys and logs are then written through the pointers
+    void allocate(size_t n, const TableParams& table_params, uint64_t*& keys_out, int128_t*& logs_out);
+
+    // Fills the bucket offsets of an allocated image from its sorted keys
+    void build_index();
+
+    bool readPacked(std::string path);
+};
+
+// Compressed table for solving, after Bernstein and Lange: a match only has to point at a candidate that is verified
+// anyway, so each entry keeps the top key_bits bits of its fingerprint and the low log_bits bits of its log. Entries
+// are sorted and bit-packed behind an index over the top key bits, 8 to 16 entries per bucket, so a bucket only stores
+// the key bits below its index. Matches may be false and give the log modulo 2^log_bits; the caller searches the range
+// of table logs for the full log and verifies it.
+struct CompressedTable {
+    int key_bits = 64;
+    int log_bits = 128;
+    int bucket_bits = 0;
+    size_t count = 0;
+    std::vector<uint64_t> offsets;
+    std::vector<uint64_t> entries;
+
+    CompressedTable() = default;
+
+    // key_bits in 1..64, log_bits in 1..128
+    CompressedTable(const FrozenTable& table, int key_bits, int log_bits);
+
+    // Appends the truncated logs of the entries that match the key to logs, returns their number
+    size_t find(uint64_t key, std::vector<uint128_t>& logs) const;
+
+    size_t size() const { return count; }
+
+    size_t memory_bytes() const { return (offsets.size() + entries.size()) * sizeof(uint64_t); }
+
+private:
+    int rest_bits() const { return key_bits - bucket_bits; }
+};
+
+// Record of a PerfectHashTable, padded so that it never straddles a cache line.
+struct alignas(32) PerfectHashRecord {
+    uint64_t key;
+    uint64_t unused;
+    int128_t log;
+};
+
+// Static index over a frozen table: a perfect hash in the style of PTHash. Keys are split into buckets of about 4 by
+// their top bits; every bucket gets a 16-bit pilot at build time so that its keys, hashed together with the pilot,
+// land on distinct free slots among n / 0.98 records. A lookup reads the bucket's pilot, which stays in cache for all
+// but the largest tables, and one record: at most two cache misses, hit or miss.
+struct PerfectHashTable {
+    uint64_t seed = 0;
+    std::vector<uint16_t> pilots;
+    std::vector<PerfectHashRecord> records;
+    size_t count = 0;
+
+    PerfectHashTable() = default;
+
+    explicit PerfectHashTable(const FrozenTable& table);
+
+    bool find(uint64_t key, int128_t& log) const {
+        if (!count) return false;
+
+        const PerfectHashRecord& record = records[slot(key, pilots[bucket(key)])];
+        if (record.key != key) return false;
+        log = record.log;
+        return true;
+    }
+
+    size_t size() const { return count; }
+
+    size_t memory_bytes() const {
+        return pilots.size() * sizeof(uint16_t) + records.size() * sizeof(PerfectHashRecord);
+    }
+
+private:
+    size_t bucket(uint64_t key) const { return (size_t) (((uint128_t) key * pilots.size()) >> 64); }
+
+    size_t slot(uint64_t key, uint16_t pilot) const {
+        uint64_t h = key ^ seed ^ (pilot * 0x9e3779b97f4a7c15ULL);
+        h ^= h >> 33;
+        h *= 0xff51afd7ed558ccdULL;
+        h ^= h >> 33;
+        return (size_t) (((uint128_t) h * records.size()) >> 64);
+    }
+
+    bool build(const FrozenTable& table);
 };
 
+// Prefilter for table lookups: a split block Bloom filter over the fingerprints. Every key sets one bit in each of
+// the 8 words of one 32-byte block, so a query reads a single cache line. Keys in the table always pass; other keys
+// pass with a probability of about 1.3% at 10 bits per key and 0.2% at 16.
+struct TableFilter {
+    struct alignas(32) Block {
+        uint32_t words[8];
+    };
+
+    std::vector<Block> blocks;
+
+    TableFilter() = default;
+
+    TableFilter(const uint64_t* keys, size_t count, int bits_per_key);
+
+    bool may_contain(uint64_t key) const {
+        const Block& block = blocks[block_of(key)];
+        uint32_t missing = 0;
+        for (int j = 0; j < 8; ++j) missing |= ~block.words[j] & bit_of(key, j);
+        return !missing;
+    }
+
+    size_t memory_bytes() const { return blocks.size() * sizeof(Block); }
+
+private:
+    // The block from the top 32 bits, the bits from the low 32 bits of the key
+    size_t block_of(uint64_t key) const { return (size_t) (((key >> 32) * blocks.size()) >> 32); }
+
+    static uint32_t bit_of(uint64_t key, int j) {
+        static const uint32_t salt[8] = {0x47b6137bU, 0x44974d91U, 0x8824ad5bU, 0xa2b7289dU,
+                                         0x705495c7U, 0x2df1424bU, 0x9efc4947U, 0x5c6bfb31U};
+        return (uint32_t) 1 << (((uint32_t) key * salt[j]) >> 27);
+    }
+};
+
+// Nanoseconds per lookup of the frozen table and of its perfect hash index, for keys in the table and random keys,
+// and per random key on the frozen table behind a filter of filter_bits bits per key if that is not 0.
+struct TableBenchmark {
+    double frozen_hit;
+    double frozen_miss;
+    double perfect_hit;
+    double perfect_miss;
+    double filtered_miss;
+    double perfect_build_millis;
+    size_t perfect_bytes;
+};
+
+TableBenchmark benchmark_table_lookups(const FrozenTable& table, size_t lookups, int filter_bits);
+
+struct TableMergeResult {
+    size_t read;
+    size_t distinct;
+    size_t kept;
+    // Fewest hits of a kept point
+    uint64_t min_hits;
+    // Kept points with min_hits hits, and the distinct points by their number of hits
+    size_t kept_at_min;
+    std::map<uint64_t, size_t> by_hits;
+};
+
+// Merges table and shard files generated with the same parameters into a table file at out_path with the n points
+// that most walks reached, counting the hits of a point over all inputs; an entry of a table file counts as one hit.
+// Inputs are streamed in key order four times, first to count the points of every hit count and then once for each
+// of the keys, logs and bucket offsets of the kept ones, so memory does not grow with the tables, except for decoded
+// packed inputs. The output goes through a BlockWriter to out_path.tmp, which replaces out_path once it is synced;
+// a write error throws and leaves out_path as it was.
+TableMergeResult merge_tables(const std::vector<std::string>& paths, size_t n, std::string out_path);
+
+// Number of distinct points in table and shard files generated with the same parameters, streamed once in key order
+size_t count_distinct(const std::vector<std::string>& paths);
 
 #endif //KANGAROO___TABLE_H
@@ -1,9 +1,34 @@
 #include <iostream>
 #include <getopt.h>
 #include <cstdlib>
+#include <sstream>
 
 #include "../headers/arguments.h"
 
+// Codes of the options that have no short form
+enum LongOption {
+    OPT_GROUP_PARAMS = 256,
+    OPT_GROUP_P,
+    OPT_GROUP_G,
+    OPT_GROUP_ORDER,
+    OPT_KERNEL,
+    OPT_GROUP_CURVE,
+    OPT_NEGATION_MAP,
+    OPT_TABLE_KEY_BITS,
+    OPT_TABLE_LOG_BITS,
+    OPT_TABLE_FORMAT,
+    OPT_TABLE_INDEX,
+    OPT_TABLE_BENCHMARK,
+    OPT_TABLE_FILTER,
+    OPT_CHECKPOINT_INTERVAL,
+    OPT_RESUME,
+    OPT_TABLE_SHARD,
+    OPT_MERGE_TABLES,
+    OPT_COORDINATOR,
+    OPT_WORKER,
+    OPT_MEMORY_BUDGET,
+};
+
 ParsedArgs parse_args(int argc, char *argv[]) {
     ParsedArgs args = {};
 
@@ -18,6 +43,27 @@ ParsedArgs parse_args(int argc, char *argv[]) {
             {"allow-write-table", required_argument, nullptr, 't'},
             {"secret-size", required_argument, nullptr, 's'},
             {"secrets-bin", required_argument, nullptr, 'b'},
+            {"group-params", required_argument, nullptr, OPT_GROUP_PARAMS},
+            {"group-p", required_argument, nullptr, OPT_GROUP_P},
+            {"group-g", required_argument, nullptr, OPT_GROUP_G},
+            {"group-order", required_argument, nullptr, OPT_GROUP_ORDER},
+            {"kernel", required_argument, nullptr, OPT_KERNEL},
+            {"group-curve", required_argument, nullptr, OPT_GROUP_CURVE},
+            {"negation-map", required_argument, nullptr, OPT_NEGATION_MAP},
+            {"table-key-bits", required_argument, nullptr, OPT_TABLE_KEY_BITS},
+            {"table-log-bits", required_argument, nullptr, OPT_TABLE_LOG_BITS},
+            {"table-format", required_argument, nullptr, OPT_TABLE_FORMAT},
+            {"table-index", required_argument, nullptr, OPT_TABLE_INDEX},
+            {"table-benchmark", required_argument, nullptr, OPT_TABLE_BENCHMARK},
+            {"table-filter", required_argument, nullptr, OPT_TABLE_FILTER},
+            {"checkpoint-interval", required_argument, nullptr, OPT_CHECKPOINT_INTERVAL},
+            {"resume", required_argument, nullptr, OPT_RESUME},
+            {"table-shard", required_argument, nullptr, OPT_TABLE_SHARD},
+            {"merge-tables", required_argument, nullptr, OPT_MERGE_TABLES},
+            {"coordinator", required_argument, nullptr, OPT_COORDINATOR},
+            {"worker", required_argument, nullptr, OPT_WORKER},
+            {"memory-budget", required_argument, nullptr, OPT_MEMORY_BUDGET},
+            {nullptr, 0, nullptr, 0},
     };
 
     int opt;
@@ -57,6 +103,71 @@ ParsedArgs parse_args(int argc, char *argv[]) {
                 args.secret_path = optarg;
                 std::cout << args.secret_path << std::endl;
                 break;
+            case OPT_GROUP_PARAMS:
+                args.group_params_path = optarg;
+                break;
+            case OPT_GROUP_P:
+                args.group_p = optarg;
+                break;
+            case OPT_GROUP_G:
+                args.group_g = optarg;
+                break;
+            case OPT_GROUP_ORDER:
+                args.group_order = optarg;
+                break;
+            case OPT_KERNEL:
+                args.kernel = optarg;
+                break;
+            case OPT_GROUP_CURVE:
+                args.group_curve = optarg;
+                break;
+            case OPT_NEGATION_MAP:
+                args.no_negation_map = std::strtol(optarg, nullptr, 10) == 0;
+                break;
+            case OPT_TABLE_KEY_BITS:
+                args.table_key_bits = std::strtol(optarg, nullptr, 10);
+                break;
+            case OPT_TABLE_LOG_BITS:
+                args.table_log_bits = std::strtol(optarg, nullptr, 10);
+                break;
+            case OPT_TABLE_FORMAT:
+                args.table_format = optarg;
+                break;
+            case OPT_TABLE_INDEX:
+                args.table_index = optarg;
+                break;
+            case OPT_TABLE_BENCHMARK:
+                args.table_benchmark = std::strtol(optarg, nullptr, 10);
+                break;
+            case OPT_TABLE_FILTER:
+                args.table_filter_bits = std::strtol(optarg, nullptr, 10);
+                break;
+            case OPT_CHECKPOINT_INTERVAL:
+                args.checkpoint_interval = std::strtol(optarg, nullptr, 10);
+                break;
+            case OPT_RESUME:
+                args.resume = std::strtol(optarg, nullptr, 10) != 0;
+                break;
+            case OPT_TABLE_SHARD:
+                args.table_shard = std::strtol(optarg, nullptr, 10);
+                break;
+            case OPT_MERGE_TABLES: {
+                // Comma-separated paths
+                std::stringstream paths(optarg);
+                for (std::string path; std::getline(paths, path, ',');) {
+                    if (!path.empty()) args.merge_tables.push_back(path);
+                }
+                break;
+            }
+            case OPT_COORDINATOR:
+                args.coordinator_address = optarg;
+                break;
+            case OPT_WORKER:
+                args.worker_address = optarg;
+                break;
+            case OPT_MEMORY_BUDGET:
+                args.memory_budget = std::strtol(optarg, nullptr, 10);
+                break;
             default:
                 exit(EXIT_FAILURE);
         }
@@ -0,0 +1,109 @@
+#include <gmpxx.h>
+#include <string>
+
+#include "../headers/curve.h"
+
+namespace {
+    mpz_class mod(const mpz_class &x, const mpz_class &p) {
+        mpz_class r;
+        mpz_mod(r.get_mpz_t(), x.get_mpz_t(), p.get_mpz_t());
+        return r;
+    }
+
+    mpz_class inverse(const mpz_class &x, const mpz_class &p) {
+        mpz_class r;
+        mpz_invert(r.get_mpz_t(), x.get_mpz_t(), p.get_mpz_t());
+        return r;
+    }
+
+    CurveParams make_secp256k1() {
+        CurveParams curve;
+        curve.name = "secp256k1";
+        curve.p = mpz_class("0xfffffffffffffffffffffffffffffffffffffffffffffffffffffffefffffc2f", 0);
+        curve.a = 0;
+        curve.b = 7;
+        curve.gx = mpz_class("0x79be667ef9dcbbac55a06295ce870b07029bfcdb2dce28d959f2815b16f81798", 0);
+        curve.gy = mpz_class("0x483ada7726a3c4655da4fbfc0e1108a8fd17b448a68554199c47d08ffb10d4b8", 0);
+        curve.n = mpz_class("0xfffffffffffffffffffffffffffffffebaaedce6af48a03bbfd25e8cd0364141", 0);
+        return curve;
+    }
+
+    // Curve25519 v^2 = u^3 + A * u^2 + u maps to y^2 = x^3 + a * x + b by x = u + A / 3, y = v, with
+    // a = (3 - A^2) / 3 and b = (2 * A^3 - 9 * A) / 27. The base point is u = 9 with v from RFC 7748, the image of the
+    // Ed25519 base point.
+    CurveParams make_wei25519() {
+        CurveParams curve;
+        curve.name = "ed25519";
+        curve.p = (mpz_class(1) << 255) - 19;
+        const mpz_class A = 486662;
+        const mpz_class third = inverse(3, curve.p);
+        curve.a = mod((3 - A * A) * third, curve.p);
+        curve.b = mod((2 * A * A * A - 9 * A) * inverse(27, curve.p), curve.p);
+        curve.gx = mod(9 + A * third, curve.p);
+        curve.gy = mpz_class("14781619447589544791020593568409986887264606134616475288964881837755586237401");
+        curve.n = (mpz_class(1) << 252) + mpz_class("27742317777372353535851937790883648493");
+        return curve;
+    }
+}
+
+const CurveParams* find_curve(const std::string& name) {
+    static const CurveParams secp256k1 = make_secp256k1();
+    static const CurveParams wei25519 = make_wei25519();
+
+    if (name == "secp256k1") return &secp256k1;
+    if (name == "ed25519" || name == "wei25519") return &wei25519;
+    return nullptr;
+}
+
+bool on_curve(const CurveParams& curve, const AffinePoint& P) {
+    if (P.infinity) return true;
+    if (P.x < 0 || P.x >= curve.p || P.y < 0 || P.y >= curve.p) return false;
+
+    return mod(P.y * P.y - (P.x * P.x * P.x + curve.a * P.x + curve.b), curve.p) == 0;
+}
+
+AffinePoint curve_add(const CurveParams& curve, const AffinePoint& P, const AffinePoint& Q) {
+    if (P.infinity) return Q;
+    if (Q.infinity) return P;
+
+    mpz_class lambda;
+    if (P.x == Q.x) {
+        if (mod(P.y + Q.y, curve.p) == 0) return AffinePoint{0, 0, true};
+        lambda = mod((3 * P.x * P.x + curve.a) * inverse(2 * P.y, curve.p), curve.p);
+    } else {
+        lambda = mod((Q.y - P.y) * inverse(mod(Q.x - P.x, curve.p), curve.p), curve.p);
+    }
+
+    mpz_class x = mod(lambda * lambda - P.x - Q.x, curve.p);
+    mpz_class y = mod(lambda * (P.x - x) - P.y, curve.p);
+    return AffinePoint{x, y, false};
+}
+
+AffinePoint curve_mul(const CurveParams& curve, const AffinePoint& P, const mpz_class& e) {
+    AffinePoint base = P;
+    if (e < 0 && !base.infinity) base.y = mod(-base.y, curve.p);
+    mpz_class k = abs(e);
+
+    AffinePoint result{0, 0, true};
+    for (long bit = (long) mpz_sizeinbase(k.get_mpz_t(), 2) - 1; bit >= 0 && k != 0; --bit) {
+        result = curve_add(curve, result, result);
+        if (mpz_tstbit(k.get_mpz_t(), bit)) result = curve_add(curve, result, base);
+    }
+    return result;
+}
+
+mpz_class encode_point(const AffinePoint& P) {
+    if (P.infinity) return 0;
+    return (P.x << 256) + P.y;
+}
+
+AffinePoint decode_point(const mpz_class& encoded) {
+    if (encoded == 0) return AffinePoint{0, 0, true};
+
+    mpz_class x = encoded >> 256;
+    mpz_class y = encoded - (x << 256);
+    return AffinePoint{x, y, false};
+}
+
+template struct CurveGroup<Fp256>;
+template struct CurveGroup<PseudoMersenneField<4>>;
@@ -0,0 +1,184 @@
+#include <gmpxx.h>
+#include <cstring>
+#include <stdexcept>
+
+#include "../headers/field.h"
+
+namespace {
+    // Writes x (0 <= x < 2^(64 * n)) into n little-endian 64-bit limbs.
+    void export_limbs(void* limbs, size_t n, const mpz_class &x) {
+        std::memset(limbs, 0, n * sizeof(uint64_t));
+        size_t count = 0;
+        mpz_export(limbs, &count, -1, sizeof(uint64_t), 0, 0, x.get_mpz_t());
+    }
+
+    mpz_class import_limbs(const void* limbs, size_t n) {
+        mpz_class x;
+        mpz_import(x.get_mpz_t(), n, -1, sizeof(uint64_t), 0, 0, limbs);
+        return x;
+    }
+
+    // Computes -m^-1 mod 2^64 for an odd m with Newton iterations.
+    uint64_t neg_inverse_64(uint64_t m) {
+        uint64_t inv = m;
+        for (int i = 0; i < 6; ++i) inv *= 2 - m * inv;
+        return 0 - inv;
+    }
+}
+
+Fp256::Fp256(const mpz_class &modulus) {
+    if (modulus <= 2 || mpz_even_p(modulus.get_mpz_t()) || mpz_sizeinbase(modulus.get_mpz_t(), 2) > 256) {
+        throw std::invalid_argument("Fp256 requires an odd modulus of at most 256 bits");
+    }
+
+    export_limbs(p, 4, modulus);
+    n0 = neg_inverse_64(p[0]);
+
+    mpz_class r2_value = (mpz_class(1) << 512) % modulus;
+    export_limbs(r2.v, 4, r2_value);
+
+    mpz_class one_value = (mpz_class(1) << 256) % modulus;
+    export_limbs(one.v, 4, one_value);
+}
+
+Fp256::Element Fp256::from_mpz(const mpz_class &x) const {
+    mpz_class reduced = x % import_limbs(p, 4);
+    if (reduced < 0) reduced += import_limbs(p, 4);
+
+    Element plain, result;
+    export_limbs(plain.v, 4, reduced);
+    mul(result, plain, r2);
+    return result;
+}
+
+mpz_class Fp256::to_mpz(const Element &x) const {
+    Element unit = {{1, 0, 0, 0}};
+    Element plain;
+    mul(plain, x, unit);
+    return import_limbs(plain.v, 4);
+}
+
+template <int N>
+bool PseudoMersenneField<N>::supports(const mpz_class &modulus) {
+    if (modulus <= 2 || mpz_even_p(modulus.get_mpz_t())) return false;
+
+    size_t k = mpz_sizeinbase(modulus.get_mpz_t(), 2);
+    if (k <= 64 * (N - 1) || k > 64 * N) return false;
+
+    mpz_class c_fold = ((mpz_class(1) << k) - modulus) << (64 * N - k);
+    return mpz_sizeinbase(c_fold.get_mpz_t(), 2) <= 64;
+}
+
+template <int N>
+PseudoMersenneField<N>::PseudoMersenneField(const mpz_class &modulus) {
+    if (!supports(modulus)) {
+        throw std::invalid_argument("PseudoMersenneField requires p = 2^k - c with a small c");
+    }
+
+    k = mpz_sizeinbase(modulus.get_mpz_t(), 2);
+    mpz_class c_value = (mpz_class(1) << k) - modulus;
+    c = mpz_get_ui(c_value.get_mpz_t());
+    c_fold = c << (64 * N - k);
+    export_limbs(p, N, modulus);
+}
+
+template <int N>
+const char* PseudoMersenneField<N>::name() {
+    static const std::string name = "pseudo-mersenne" + std::to_string(64 * N);
+    return name.c_str();
+}
+
+template <int N>
+typename PseudoMersenneField<N>::Element PseudoMersenneField<N>::from_mpz(const mpz_class &x) const {
+    mpz_class modulus = import_limbs(p, N);
+    mpz_class reduced = x % modulus;
+    if (reduced < 0) reduced += modulus;
+
+    Element result;
+    export_limbs(result.v, N, reduced);
+    return result;
+}
+
+template <int N>
+mpz_class PseudoMersenneField<N>::to_mpz(const Element &x) const {
+    return import_limbs(x.v, N);
+}
+
+template struct PseudoMersenneField<4>;
+template struct PseudoMersenneField<8>;
+
+template <int N>
+MontField<N>::MontField(const mpz_class &modulus) {
+    if (modulus <= 2 || mpz_even_p(modulus.get_mpz_t()) || mpz_sizeinbase(modulus.get_mpz_t(), 2) > 64 * N) {
+        throw std::invalid_argument("MontField requires an odd modulus that fits its limbs");
+    }
+
+    export_limbs(p, N, modulus);
+    n0 = neg_inverse_64(p[0]);
+
+    mpz_class r2_value = (mpz_class(1) << (128 * N)) % modulus;
+    export_limbs(r2.v, N, r2_value);
+
+    mpz_class one_value = (mpz_class(1) << (64 * N)) % modulus;
+    export_limbs(one.v, N, one_value);
+}
+
+template <int N>
+const char* MontField<N>::name() {
+    static const std::string name = "mont" + std::to_string(64 * N) + "-mpn";
+    return name.c_str();
+}
+
+template <int N>
+typename MontField<N>::Element MontField<N>::from_mpz(const mpz_class &x) const {
+    mpz_class modulus = import_limbs(p, N);
+    mpz_class reduced = x % modulus;
+    if (reduced < 0) reduced += modulus;
+
+    Element plain, result;
+    export_limbs(plain.v, N, reduced);
+    mul(result, plain, r2);
+    return result;
+}
+
+template <int N>
+mpz_class MontField<N>::to_mpz(const Element &x) const {
+    Element unit = {};
+    unit.v[0] = 1;
+    Element plain;
+    mul(plain, x, unit);
+    return import_limbs(plain.v, N);
+}
+
+template struct MontField<8>;
+template struct MontField<16>;
+template struct MontField<24>;
+template struct MontField<32>;
+template struct MontField<48>;
+template struct MontField<64>;
+
+FieldBackend make_field(const mpz_class &p) {
+    if (mpz_even_p(p.get_mpz_t()) || p <= 2) {
+        return FieldBackend(std::in_place_type<MpzField>, p);
+    }
+
+    if (PseudoMersenneField<4>::supports(p)) return FieldBackend(std::in_place_type<PseudoMersenneField<4>>, p);
+    if (PseudoMersenneField<8>::supports(p)) return FieldBackend(std::in_place_type<PseudoMersenneField<8>>, p);
+
+    size_t bits = mpz_sizeinbase(p.get_mpz_t(), 2);
+    bool montgomery_friendly = mpz_getlimbn(p.get_mpz_t(), 0) == ~mp_limb_t(0);
+    if (bits <= 256 && montgomery_friendly) return FieldBackend(std::in_place_type<Fp256Friendly>, p);
+    if (bits <= 256) return FieldBackend(std::in_place_type<Fp256>, p);
+    if (bits <= 512) return FieldBackend(std::in_place_type<MontField<8>>, p);
+    if (bits <= 1024) return FieldBackend(std::in_place_type<MontField<16>>, p);
+    if (bits <= 1536) return FieldBackend(std::in_place_type<MontField<24>>, p);
+    if (bits <= 2048) return FieldBackend(std::in_place_type<MontField<32>>, p);
+    if (bits <= 3072) return FieldBackend(std::in_place_type<MontField<48>>, p);
+    if (bits <= 4096) return FieldBackend(std::in_place_type<MontField<64>>, p);
+
+    return FieldBackend(std::in_place_type<MpzField>, p);
+}
+
+std::string field_name(const FieldBackend &field) {
+    return std::visit([](const auto &f) { return std::string(f.name()); }, field);
+}
@@ -0,0 +1,20 @@
+#include <gmpxx.h>
+
+#include "../headers/fixed_base.h"
+
+FixedBasePowers::FixedBasePowers(const mpz_class &g, const mpz_class &identity,
+                                 const std::function<mpz_class(const mpz_class&, const mpz_class&)> &mul,
+                                 int max_bits, int window_bits)
+        : window_bits(window_bits), windows((max_bits + window_bits - 1) / window_bits), identity(identity),
+          powers((size_t) windows << window_bits) {
+    // base = g^(2^(k * window_bits)) for the current window k
+    mpz_class base = g;
+    for (int k = 0; k < windows; ++k) {
+        mpz_class* row = powers.data() + ((size_t) k << window_bits);
+        row[0] = identity;
+        for (size_t d = 1; d < (size_t(1) << window_bits); ++d) {
+            row[d] = mul(row[d - 1], base);
+        }
+        base = mul(row[(size_t(1) << window_bits) - 1], base);
+    }
+}
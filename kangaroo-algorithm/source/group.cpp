@@ -0,0 +1,21 @@
+#include <gmpxx.h>
+#include <string>
+#include <variant>
+
+#include "../headers/group.h"
+
+GroupBackend make_group_backend(const GroupParams &params) {
+    if (!params.curve.empty()) {
+        CurveParams curve = group_curve(params);
+        if (PseudoMersenneField<4>::supports(curve.p)) {
+            return GroupBackend(std::in_place_type<CurveGroup<PseudoMersenneField<4>>>, curve, params.negation_map);
+        }
+        return GroupBackend(std::in_place_type<CurveGroup<Fp256>>, curve, params.negation_map);
+    }
+
+    return std::visit([](auto &&field) -> GroupBackend { return GroupBackend(field); }, make_field(params.p));
+}
+
+std::string backend_name(const GroupBackend &backend) {
+    return std::visit([](const auto &b) { return std::string(b.name()); }, backend);
+}
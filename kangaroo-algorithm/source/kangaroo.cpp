@@ -1,14 +1,26 @@
 #include <gmpxx.h>
 #include <unordered_map>
 #include <iostream>
+#include <fstream>
 #include <thread>
 #include <mutex>
 #include <vector>
 #include <algorithm>
 #include <atomic>
+#include <chrono>
+#include <variant>
+#include <stdexcept>
+#include <cerrno>
+#include <cstdint>
+#include <sys/socket.h>
+#include <unistd.h>
 
 #include "../headers/kangaroo.h"
+#include "../headers/lanes.h"
+#include "../headers/fixed_base.h"
+#include "../headers/start_points.h"
 #include "../headers/logger.h"
+#include "../headers/socket.h"
 
 using std::lower_bound;
 std::timed_mutex mut;
@@ -20,31 +32,54 @@ KangarooAlgorithm::KangarooAlgorithm(
         double i,
         double m,
         long r,
-        mpz_class p
-): N(n), secret_size(secret_size), W(w), i(i), R(r), p(p), m(m){
-    l = power(mpz_class(2), mpz_class(secret_size));
-
-    g = p / l; g = (g * g) % p;
+        const GroupParams& group
+): N(n), secret_size(secret_size), W(w), i(i), R(r), p(group.p), m(m), order(group.order),
+   backend(make_group_backend(group)), elliptic(!group.curve.empty()),
+   negation_map(!group.curve.empty() && group.negation_map) {
+    l = mpz_class(1) << secret_size;
+
+    if (elliptic) {
+        curve = group_curve(group);
+        g = group.g;
+    } else if (group.g != 0) {
+        g = group.g;
+    } else {
+        g = p / l; g = (g * g) % p;
+    }
 }
 
-int KangarooAlgorithm::distinguished(const mpz_class &w)
+int KangarooAlgorithm::distinguished(uint64_t w)
 {
-    return !(w.get_si() & (W-1));
+    return !(w & (W-1));
 }
 
-int KangarooAlgorithm::hash(const mpz_class &w)
+int KangarooAlgorithm::hash(uint64_t w)
 {
-    return w.get_si() & (R-1);
+    return w & (R-1);
 }
 
 mpz_class KangarooAlgorithm::power(const mpz_class &g, const mpz_class &e)
 {
+    if (elliptic) return encode_point(curve_mul(curve, decode_point(g), e));
+
     mpz_class result;
 
     mpz_powm(result.get_mpz_t(),g.get_mpz_t(),e.get_mpz_t(),p.get_mpz_t());
     return result;
 }
 
+mpz_class KangarooAlgorithm::group_mul(const mpz_class &a, const mpz_class &b)
+{
+    if (elliptic) return encode_point(curve_add(curve, decode_point(a), decode_point(b)));
+
+    return a * b % p;
+}
+
+mpz_class KangarooAlgorithm::identity()
+{
+    return elliptic ? encode_point(AffinePoint{0, 0, true}) : mpz_class(1);
+}
+
 // Init s and slog arrays. Note, that this method needs to be run before solve_dlp() method.
 void KangarooAlgorithm::init_s() {
     mpf_class float_l(l);
@@ -53,118 +88,592 @@ void KangarooAlgorithm::init_s() {
     slog = new mpz_class[R];
     for (int i = 0;i < R;++i) slog[i] = ra.get_z_range(ra.get_z_bits(secret_size-2) / W);
 
+    init_jumps();
+}
+
+void KangarooAlgorithm::init_jumps() {
+    delete[] s;
     s = new mpz_class[R];
     for (int i = 0;i < R;++i) s[i] = power(g,slog[i]);
+
+    // Walk distances (start exponent plus jumps) are tracked in native integers, which covers every interval that is
+    // feasible to solve; the table stores them as signed 128-bit logs
+    mpz_class max_slog = 0;
+    for (int i = 0;i < R;++i) max_slog = std::max(max_slog, slog[i]);
+    long max_steps = std::max(8 * W, static_cast<long>(i * W));
+    mpz_class max_distance = l + max_slog * max_steps;
+    size_t bits = mpz_sizeinbase(max_distance.get_mpz_t(), 2);
+    // 128-bit sums are read as signed by the drivers, see LaneKernel
+    distance_bits = bits <= 64 ? 64 : bits < 128 ? 128 : 0;
+
+    if (!distance_bits) {
+        throw std::invalid_argument("walk distances need to stay below 2^127, use a smaller secret size or W");
+    }
+
+    // Generation walks start below l and take at most 8 * W jumps; with the negation map a walk's log may also be the
+    // negation of such a sum
+    table_log_max = l + max_slog * 8 * W;
+    table_log_min = negation_map ? mpz_class(-table_log_max) : mpz_class(0);
+
+    // Walks start at g^e with e of at most secret_size bits
+    g_powers = FixedBasePowers(g, identity(), [this](const mpz_class &a, const mpz_class &b) { return group_mul(a, b); },
+                               std::max(secret_size, 1));
+}
+
+TableParams KangarooAlgorithm::table_params() {
+    TableParams params;
+    params.R = R;
+    params.W = W;
+    params.secret_size = secret_size;
+    params.negation_map = negation_map;
+    params.p = p.get_str(16);
+    params.g = g.get_str(16);
+    params.order = order.get_str(16);
+    params.curve = elliptic ? curve.name : "";
+    params.backend = backend_name(backend);
+    for (int i = 0;i < R;++i) params.slog.push_back(mpz_to_u128(slog[i]));
+    return params;
+}
+
+std::string KangarooAlgorithm::table_params_mismatch(const TableParams& params) {
+    const TableParams own = table_params();
+    if (params.R != own.R) return "R is " + std::to_string(params.R) + ", not " + std::to_string(own.R);
+    if (params.W != own.W) return "W is " + std::to_string(params.W) + ", not " + std::to_string(own.W);
+    if (params.secret_size != own.secret_size) {
+        return "secret size is " + std::to_string(params.secret_size) + ", not " + std::to_string(own.secret_size);
+    }
+    if (params.curve != own.curve) return "curve is '" + params.curve + "', not '" + own.curve + "'";
+    if (params.p != own.p) return "p is 0x" + params.p + ", not 0x" + own.p;
+    if (params.g != own.g) return "g is 0x" + params.g + ", not 0x" + own.g;
+    if (params.order != own.order) return "order of g is 0x" + params.order + ", not 0x" + own.order;
+    if (params.negation_map != own.negation_map) {
+        return std::string("negation map is ") + (params.negation_map ? "on" : "off");
+    }
+    // Walks branch on labels of the backend's representation, so other backends take other walks
+    if (params.backend != own.backend) return "backend is " + params.backend + ", not " + own.backend;
+    return "";
 }
 
-void KangarooAlgorithm::parallel_loop_map(std::unordered_map<std::string, long long>& distinguishedCounter,
-                                      int& tabledone, gmp_randclass& ra, int i, int W, mpz_class g,
-                                      mpz_class* slog, mpz_class* s, mpz_class p, int thread_num) {
+void KangarooAlgorithm::restore_jumps(const std::vector<uint128_t>& jump_logs) {
+    for (int i = 0;i < R;++i) slog[i] = u128_to_mpz(jump_logs[i]);
+    init_jumps();
+}
+
+size_t KangarooAlgorithm::jump_entry_size() {
+    return std::visit([](const auto &F) -> size_t {
+        return sizeof(Jump<typename std::decay_t<decltype(F)>::Element>);
+    }, backend);
+}
+
+std::string KangarooAlgorithm::lane_kernel_name() {
+    return std::visit([](const auto &F) -> std::string {
+        typedef std::decay_t<decltype(F)> Field;
+        if (is_curve_group<Field>::value) return "ec-batched-affine";
+        if (std::is_base_of<Fp256, Field>::value) return kernel_kind_name(selected_kernel());
+        return kernel_kind_name(KERNEL_GENERIC);
+    }, backend);
+}
+
+template <typename Field>
+void KangarooAlgorithm::parallel_loop_map(std::atomic<long long>& numsteps, size_t limit, uint64_t seed,
+                                          const Field& F, int thread_num,
+                                          std::chrono::steady_clock::time_point deadline) {
     std::cout << "running #" << thread_num << "\n";
-    long long numsteps = 0;
-    while (tabledone < N) {
-        mpz_class wlog = ra.get_z_bits(secret_size);
-        mpz_class w = power(g, wlog);
 
-        for (int loop = 0;loop < 8*W;++loop) {
-            if (distinguished(w)) {
-                mut.lock();
-                auto distEntry = tableMap.tableMap[w.get_str(16)];
-                mut.unlock();
+    // The jump table is kept in the field representation for the whole walk
+    JumpTable<typename Field::Element> jumps = make_jump_table(F, s, slog, R);
 
-                if (distEntry.log == 0) {
-                    tableMap.tableMap[w.get_str(16)] = TableEntryMap{wlog};
+    table_lanes(F, jumps, limit, numsteps, seed, deadline);
+}
 
-                    std::cout << "tabledone: " << tabledone << "/" << N << std::endl;
-                    ++tabledone;
-                }
+// Generates table entries with a lane kernel: every lane runs its own walk, lanes that reach a distinguished point or
+// the step limit are handled here and restarted.
+template <typename Field>
+void KangarooAlgorithm::table_lanes(const Field& F, const JumpTable<typename Field::Element>& jumps, size_t limit,
+                                    std::atomic<long long>& total_steps, uint64_t seed,
+                                    std::chrono::steady_clock::time_point deadline) {
+    auto kernel = make_lane_kernel(F, LaneJumps<typename Field::Element>{jumps.data(), R, W, distance_bits == 64});
+    const int lanes = kernel->lanes();
+    const long max_steps = 8 * W;
+    FixedBase<Field> g_f(F, g_powers);
+    StartPoints<Field> starts(F, g_f, F.from_mpz(identity()), F.from_mpz(power(g, -l)), secret_size, seed);
+
+    std::vector<uint128_t> start(lanes);
+    auto restart = [&](int lane) {
+        kernel->set_lane(lane, starts.next(start[lane]));
+    };
+    for (int lane = 0; lane < lanes; ++lane) restart(lane);
+
+    // Progress is printed about every percent of the table
+    const size_t progress = std::max<size_t>(limit / 100, 1);
 
-                numsteps = 0;
-                break;
+    long long numsteps = 0;
+    while (table.size() < limit && !stop_generation && std::chrono::steady_clock::now() < deadline) {
+        uint64_t stopped = kernel->run(max_steps);
+
+        for (int lane = 0; lane < lanes; ++lane) {
+            if (!((stopped >> lane) & 1)) continue;
+
+            typename Field::Element w = kernel->get_lane(lane);
+            long steps = kernel->lane_steps(lane);
+            numsteps += steps;
+
+            if (steps < max_steps && distinguished(F.label(w))) {
+                // log of w = ±start + sum, see LaneKernel
+                int128_t wlog = (int128_t) kernel->lane_jumps(lane) +
+                                (kernel->lane_negated(lane) ? -(int128_t) start[lane] : (int128_t) start[lane]);
+                uint64_t key = point_fingerprint(F.to_mpz(w));
+
+                if (point_sink) {
+                    // The steps that led to the point go out in the point's batch
+                    total_steps += numsteps;
+                    numsteps = 0;
+                    point_sink(key, wlog);
+                } else if (table.insert_concurrent(key, wlog, limit)) {
+                    size_t done = table.size();
+                    if (done % progress == 0) std::cout << "tabledone: " << done << "/" << limit << std::endl;
+                }
             }
 
-            int h = hash(w);
-            wlog = wlog + slog[h];
-            w = (w * s[h]) % p;
-            ++numsteps;
+            restart(lane);
         }
     }
 
+    total_steps += numsteps;
+}
+
+namespace {
+    // Distinguished points per batch a worker sends
+    const size_t WORKER_BATCH = 4096;
+
+    // Histogram of the table's hit counts in power-of-two ranges
+    std::map<long long, long long> hit_histogram(const DistinguishedTable& table) {
+        std::map<long long, long long> histogram;
+        for (size_t i = 0; i < table.slots.size(); ++i) {
+            if (!table.slots[i].key) continue;
+
+            long long low = 1;
+            while (2 * low <= table.hits[i]) low *= 2;
+            ++histogram[low];
+        }
+        return histogram;
+    }
 }
 
 PreprocessingResult KangarooAlgorithm::generate_table_parallel_map() {
-    std::unordered_map<std::string, long long> distinguishedCounter;
-    long long numsteps = 0;
+    std::atomic<long long> numsteps{generation.numsteps};
 
+    // Hits are counted in any case, they show how much the walks overlap
+    const size_t candidates = m > 1 ? static_cast<size_t>(m * N) : N;
     gmp_randclass ra(gmp_randinit_default);
-    int tabledone = 0;
+    // A resumed run or another shard must not repeat the walks of the runs before it
+    if (generation.runs || shard) ra.seed((mpz_class(shard) << 32) + generation.runs);
+    ++generation.runs;
+
+    // Under a memory budget the table holds one run of at most run_size points, which is spilled to disk in key order
+    // when full; the runs are merged once the candidates are generated. Runs can share points, so once they hold target
+    // entries their distinct points are counted and more runs follow until there are candidates of them
+    const size_t run_size = spill_run_size();
+    size_t target = candidates;
+    auto run_limit = [&]() {
+        const size_t remaining = target - generation.spilled_entries;
+        return run_size ? std::min(remaining, run_size) : remaining;
+    };
+    std::atomic<size_t> limit{run_limit()};
+    table.reserve(limit);
+    if (table.hits.empty()) table.count_hits();
 
     // Number of threads to use
     int num_threads = std::thread::hardware_concurrency();
-    std::vector<std::thread> threads;
 
+    // Workers' points are inserted by one thread per worker, a batch at a time, and checkpoints wait for the batch
+    std::mutex table_mutex;
+    std::vector<int> workers;
+    std::vector<std::thread> receivers;
+    std::thread acceptor;
+    int listener = -1;
+    auto receive_points = [&](int fd) {
+        PointBatchHeader header;
+        std::vector<TableEntry> batch;
+        while (receive_all(fd, &header, sizeof(header)) && header.count <= WORKER_BATCH) {
+            batch.resize(header.count);
+            if (!receive_all(fd, batch.data(), batch.size() * sizeof(TableEntry))) break;
+
+            std::lock_guard<std::mutex> lock(table_mutex);
+            for (const TableEntry& entry : batch) table.insert_concurrent(entry.key, entry.log(), limit);
+            numsteps += header.steps;
+        }
+    };
+    if (!coordinator_address.empty()) {
+        listener = listen_on(coordinator_address);
+        const std::string params = table_params().serialize();
+        // Seeds of the workers' start points differ from each other and from those of the coordinator's runs
+        const uint64_t seed = ((uint64_t) shard << 32) + generation.runs;
+        acceptor = std::thread([&, params, seed]() {
+            for (uint64_t worker = 1;; ++worker) {
+                const int fd = accept(listener, nullptr, nullptr);
+                if (fd < 0 && errno == EINTR) continue;
+                // The listener is shut down once the table is full
+                if (fd < 0) return;
+
+                const WorkerHello hello = {params.size(), (worker << 48) + seed};
+                if (!send_all(fd, &hello, sizeof(hello)) || !send_all(fd, params.data(), params.size())) {
+                    close(fd);
+                    continue;
+                }
+                std::cout << "worker #" << worker << " connected" << std::endl;
+                workers.push_back(fd);
+                receivers.emplace_back(receive_points, fd);
+            }
+        });
+    }
+
+    auto complete = [&]() {
+        if (generation.spilled_entries + table.size() < target) return false;
+        if (!generation.spilled_runs) return true;
+
+        {
+            std::lock_guard<std::mutex> lock(table_mutex);
+            if (table.size()) spill_run();
+        }
+        std::vector<std::string> runs;
+        for (uint64_t run = 0; run < generation.spilled_runs; ++run) runs.push_back(spill_path(run));
+        const size_t distinct = count_distinct(runs);
+        std::cout << "spilled runs: " << distinct << "/" << candidates << " distinct points" << std::endl;
+        if (distinct >= candidates) return true;
+
+        // Points the workers sent during the count are in the table already
+        std::lock_guard<std::mutex> lock(table_mutex);
+        target = generation.spilled_entries + table.size() + candidates - distinct;
+        limit = run_limit();
+        table.reserve(limit);
+        table.count_hits();
+        return false;
+    };
+
+    // With checkpoints the threads stop at every interval, walks in progress are dropped
+    const bool checkpoints = checkpoint_interval > 0 && !checkpoint_path.empty();
+    while (!complete()) {
+        const auto deadline = checkpoints ? std::chrono::steady_clock::now() + std::chrono::seconds(checkpoint_interval)
+                                          : std::chrono::steady_clock::time_point::max();
+        std::vector<std::thread> threads;
+
+        for (int t = 0; t < num_threads; ++t) {
+            std::visit([&](const auto &F) {
+                // Seeds are drawn here, the random state is not shared by the threads
+                const uint64_t seed = mpz_class(ra.get_z_bits(64)).get_ui();
+                threads.emplace_back([&, t, seed]() { parallel_loop_map(numsteps, limit, seed, F, t, deadline); });
+            }, backend);
+        }
+
+        // Wait for all threads to finish
+        for (auto& thread : threads) {
+            thread.join();
+        }
+
+        if (run_size && table.size() >= limit && generation.spilled_entries + table.size() < target) {
+            std::lock_guard<std::mutex> lock(table_mutex);
+            spill_run();
+            limit = run_limit();
+            table.reserve(limit);
+            table.count_hits();
+        }
+
+        if (checkpoints && generation.spilled_entries + table.size() < target) {
+            std::lock_guard<std::mutex> lock(table_mutex);
+            generation.numsteps = numsteps;
+            generation.params = table_params();
+            if (table.writeCheckpoint(checkpoint_path, generation)) {
+                std::cout << "checkpoint: " << generation.spilled_entries + table.size() << "/" << target << " entries, " << numsteps
+                          << " steps" << std::endl;
+            } else {
+                std::cout << "checkpoint to " << checkpoint_path << " failed, generation goes on" << std::endl;
+            }
+        }
+    }
+
+    if (listener >= 0) {
+        // No more workers, then stop the connected ones and take their last batches
+        shutdown(listener, SHUT_RDWR);
+        acceptor.join();
+        close_listener(listener, coordinator_address);
+        const char stop = 1;
+        for (int fd : workers) send_all(fd, &stop, sizeof(stop));
+        for (auto& receiver : receivers) receiver.join();
+        for (int fd : workers) close(fd);
+    }
+
+    // The points of spilled runs are only counted and selected by the merge, with the last points of the workers
+    if (generation.spilled_runs) {
+        generation.numsteps = numsteps;
+        if (table.size()) spill_run();
+        return PreprocessingResult(numsteps, {}, {}, candidates);
+    }
+
+    std::map<long long, long long> generated = hit_histogram(table);
+    if (!shard) table.keep_most_hit(N);
+
+    return PreprocessingResult(numsteps, generated, hit_histogram(table), candidates);
+}
+
+size_t KangarooAlgorithm::spill_run_size() const {
+    if (!memory_budget) return 0;
+
+    // A slot takes 24 bytes and 4 for its hits, and spilling sorts 8-byte slot indices; tables are at most half full
+    size_t slots = 16;
+    while (2 * slots * (sizeof(TableEntry) + sizeof(uint32_t) + sizeof(size_t)) <= memory_budget) slots *= 2;
+    return slots / 2;
+}
+
+std::string KangarooAlgorithm::spill_path(uint64_t run) const {
+    return spill_prefix + std::to_string(run);
+}
+
+void KangarooAlgorithm::spill_run() {
+    const std::string path = spill_path(generation.spilled_runs);
+    generation.params = table_params();
+    if (!table.writeCheckpoint(path, generation, true)) throw std::runtime_error("cannot spill the table to " + path);
+    std::cout << "spilled run #" << generation.spilled_runs << ": " << table.size() << " entries" << std::endl;
+
+    generation.spilled_entries += table.size();
+    ++generation.spilled_runs;
+    table.clear();
+}
+
+long long KangarooAlgorithm::run_worker(const std::string& address) {
+    const int fd = connect_to(address);
+    WorkerHello hello;
+    std::string serialized;
+    TableParams params;
+    if (receive_all(fd, &hello, sizeof(hello)) && hello.params_bytes < (1ULL << 32)) {
+        serialized.resize(hello.params_bytes);
+        if (!receive_all(fd, &serialized[0], serialized.size())) serialized.clear();
+    }
+    if (!params.parse(serialized.data(), serialized.size())) {
+        close(fd);
+        throw std::runtime_error("no parameters from the coordinator at " + address);
+    }
+    const std::string mismatch = table_params_mismatch(params);
+    if (!mismatch.empty()) {
+        close(fd);
+        throw std::runtime_error("the coordinator at " + address + " generates with other parameters: " + mismatch);
+    }
+    restore_jumps(params.slog);
+
+    gmp_randclass ra(gmp_randinit_default);
+    ra.seed(mpz_class((unsigned long) hello.seed));
+
+    // Points go out in batches; once the coordinator is gone sending fails, which also ends the walks
+    std::atomic<long long> numsteps{0};
+    long long sent_steps = 0;
+    std::mutex batch_mutex;
+    std::vector<TableEntry> batch;
+    auto flush = [&]() {
+        const long long steps = numsteps - sent_steps;
+        sent_steps += steps;
+        const PointBatchHeader header = {batch.size(), (uint64_t) steps};
+        if (!send_all(fd, &header, sizeof(header)) ||
+            !send_all(fd, batch.data(), batch.size() * sizeof(TableEntry))) {
+            stop_generation = true;
+        }
+        batch.clear();
+    };
+    point_sink = [&](uint64_t key, int128_t log) {
+        std::lock_guard<std::mutex> lock(batch_mutex);
+        batch.push_back(TableEntry{key, (uint64_t) log, (uint64_t) ((uint128_t) log >> 64)});
+        if (batch.size() == WORKER_BATCH) flush();
+    };
+
+    int num_threads = std::thread::hardware_concurrency();
+    std::vector<std::thread> threads;
     for (int t = 0; t < num_threads; ++t) {
-        threads.emplace_back(&KangarooAlgorithm::parallel_loop_map, this, std::ref(distinguishedCounter),
-                             std::ref(tabledone), std::ref(ra), i, W, g, slog, s, p, t);
+        std::visit([&](const auto &F) {
+            const uint64_t seed = mpz_class(ra.get_z_bits(64)).get_ui();
+            threads.emplace_back([&, t, seed]() {
+                parallel_loop_map(numsteps, SIZE_MAX, seed, F, t, std::chrono::steady_clock::time_point::max());
+            });
+        }, backend);
     }
 
-    // Wait for all threads to finish
+    // The stop byte, or the connection closing, ends the walks
+    char stop;
+    receive_all(fd, &stop, sizeof(stop));
+    stop_generation = true;
     for (auto& thread : threads) {
         thread.join();
     }
 
-    return PreprocessingResult(numsteps, distinguishedCounter);
+    flush();
+    point_sink = nullptr;
+    close(fd);
+    return numsteps;
 }
 
-// Example function that does some work and checks the stop condition
-void KangarooAlgorithm::solve_dlp_map_parallel_function(mpz_class h, MainResult& final_result, std::atomic<bool>& stopFlag, gmp_randclass& ra, int j) {
-    long numsteps = 0;
+std::string KangarooAlgorithm::resume_table(const std::string& path) {
+    GenerationCheckpoint state;
+    if (!table.readCheckpoint(path, state)) return "checkpoint " + path + " could not be read";
 
-    while (true) {
-        auto is_sol_found = stopFlag.load();
+    const std::string mismatch = table_params_mismatch(state.params);
+    if (!mismatch.empty()) {
+        table.clear();
+        return "checkpoint " + path + " was written with other parameters: " + mismatch;
+    }
 
-        if (is_sol_found) {
-            return;
+    for (uint64_t run = 0; run < state.spilled_runs; ++run) {
+        if (!std::ifstream(spill_path(run)).good()) {
+            table.clear();
+            return "spilled run " + spill_path(run) + " of checkpoint " + path + " is missing";
         }
+    }
 
-        mpz_class wdist = ra.get_z_bits(secret_size-16);
-        mpz_class w = (h * power(g, wdist)) % p;
-
-        long steps_num = i * static_cast<long>(W);
-        long loop = 0;
-        for (; loop < steps_num; ++loop) {
-            if (distinguished(w)) {
+    restore_jumps(state.params.slog);
+    generation = state;
+    return "";
+}
 
-                mut.lock();
-                auto mapEntry = tableMap.tableMap[w.get_str(16)];
-                mut.unlock();
+void KangarooAlgorithm::freeze_table() {
+    frozen_table = FrozenTable(table, table_params());
+    table.clear();
+}
 
-                if (mapEntry.log != 0) {
-                    wdist = mapEntry.log - wdist;
-                }
+void KangarooAlgorithm::filter_table(int bits_per_key) {
+    table_filter = TableFilter(frozen_table.keys, frozen_table.size(), bits_per_key);
+    filtered = true;
+}
 
-                break;
-            }
+void KangarooAlgorithm::index_table() {
+    perfect_table = PerfectHashTable(frozen_table);
+    frozen_table = FrozenTable();
+    perfect_index = true;
+}
 
-            int h_idx = hash(w);
+void KangarooAlgorithm::compress_table(int key_bits, int log_bits) {
+    compressed_table = CompressedTable(frozen_table, key_bits, log_bits);
+    frozen_table = FrozenTable();
+    compressed = true;
+}
 
-            wdist = wdist + slog[h_idx];
-            w = (w * s[h_idx]) % p;
+mpz_class KangarooAlgorithm::compressed_candidates() {
+    return ((table_log_max - table_log_min) >> compressed_table.log_bits) + 1;
+}
 
-            ++numsteps;
+bool KangarooAlgorithm::recover_log(const mpz_class& h, uint128_t low, bool negated, const mpz_class& sum,
+                                    const mpz_class& start, mpz_class& log) {
+    const mpz_class modulus = mpz_class(1) << compressed_table.log_bits;
+
+    // The first table log in range that is low modulo 2^log_bits
+    mpz_class wlog = u128_to_mpz(low) - table_log_min;
+    mpz_fdiv_r(wlog.get_mpz_t(), wlog.get_mpz_t(), modulus.get_mpz_t());
+    wlog += table_log_min;
+
+    // w = ±(h * g^start) * g^sum = g^wlog gives log_g(h) = ±(wlog - sum) - start, see solve_lanes
+    const mpz_class step = negated ? mpz_class(-modulus) : modulus;
+    mpz_class x = (negated ? mpz_class(sum - wlog) : mpz_class(wlog - sum)) - start;
+    mpz_class candidate = power(g, x);
+    const mpz_class g_step = power(g, step);
+    for (; wlog <= table_log_max; wlog += modulus) {
+        if (candidate == h) {
+            log = x;
+            return true;
         }
+        candidate = group_mul(candidate, g_step);
+        x += step;
+    }
+    return false;
+}
+
+// Example function that does some work and checks the stop condition
+template <typename Field>
+void KangarooAlgorithm::solve_dlp_map_parallel_function(const Field& F, mpz_class h, MainResult& final_result, std::atomic<bool>& stopFlag, uint64_t seed, int j) {
+    JumpTable<typename Field::Element> jumps = make_jump_table(F, s, slog, R);
+
+    solve_lanes(F, jumps, h, final_result, stopFlag, seed);
+}
 
-        // Check if the solution is found
-        if (power(g, wdist) == h) {
-            auto is_loaded = stopFlag.load();
+// Publishes a verified solution unless another thread was first.
+void KangarooAlgorithm::publish_solution(MainResult& final_result, std::atomic<bool>& stopFlag, long numsteps,
+                                         const mpz_class& log, int iter_num) {
+    auto is_loaded = stopFlag.load();
 
-            if (!is_loaded) {
-                mut.lock();
-                final_result = MainResult(numsteps, wdist, loop);
-                stopFlag.store(true);
-                mut.unlock();
+    if (!is_loaded) {
+        mut.lock();
+        final_result = MainResult(numsteps, log, iter_num);
+        stopFlag.store(true);
+        mut.unlock();
+    }
+}
+
+// Runs wild walks with a lane kernel until one of them is matched with a table entry and the log is verified.
+template <typename Field>
+void KangarooAlgorithm::solve_lanes(const Field& F, const JumpTable<typename Field::Element>& jumps, const mpz_class& h,
+                                    MainResult& final_result, std::atomic<bool>& stopFlag, uint64_t seed) {
+    auto kernel = make_lane_kernel(F, LaneJumps<typename Field::Element>{jumps.data(), R, W, distance_bits == 64});
+    const int lanes = kernel->lanes();
+    const long steps_num = i * static_cast<long>(W);
+    FixedBase<Field> g_f(F, g_powers);
+    const int start_bits = std::max(secret_size-16, 1);
+    StartPoints<Field> starts(F, g_f, F.from_mpz(h), F.from_mpz(power(g, -(mpz_class(1) << start_bits))), start_bits,
+                              seed);
+
+    std::vector<uint128_t> start(lanes);
+    auto restart = [&](int lane) {
+        kernel->set_lane(lane, starts.next(start[lane]));
+    };
+    for (int lane = 0; lane < lanes; ++lane) restart(lane);
+
+    std::vector<uint128_t> matches;
+    long numsteps = 0;
+    while (!stopFlag.load()) {
+        uint64_t stopped = kernel->run(steps_num);
+
+        for (int lane = 0; lane < lanes; ++lane) {
+            if (!((stopped >> lane) & 1)) continue;
+
+            typename Field::Element w = kernel->get_lane(lane);
+            long loop = kernel->lane_steps(lane);
+            numsteps += loop;
+
+            if (loop < steps_num && distinguished(F.label(w))) {
+                uint64_t key = point_fingerprint(F.to_mpz(w));
+
+                // Most distinguished points are not in the table, the filter turns them away from cache
+                if (filtered && !table_filter.may_contain(key)) {
+                    restart(lane);
+                    continue;
+                }
+
+                if (compressed) {
+                    matches.clear();
+                    compressed_table.find(key, matches);
+                    mpz_class sum = i128_to_mpz((int128_t) kernel->lane_jumps(lane));
+                    for (uint128_t low : matches) {
+                        mpz_class wdist;
+                        if (recover_log(h, low, kernel->lane_negated(lane), sum, u128_to_mpz(start[lane]), wdist)) {
+                            publish_solution(final_result, stopFlag, numsteps, wdist, loop);
+                            return;
+                        }
+                    }
+                    restart(lane);
+                    continue;
+                }
+
+                int128_t tlog;
+                bool found = find_in_table(key, tlog);
+
+                // Only a walk that met a table entry gives a candidate, check it
+                if (found) {
+                    // w = ±(h * g^start) * g^sum = g^log gives log_g(h) = ±(log - sum) - start
+                    mpz_class wdist = i128_to_mpz(tlog) - i128_to_mpz((int128_t) kernel->lane_jumps(lane));
+                    if (kernel->lane_negated(lane)) wdist = -wdist;
+                    wdist -= u128_to_mpz(start[lane]);
+                    if (power(g, wdist) == h) {
+                        publish_solution(final_result, stopFlag, numsteps, wdist, loop);
+                        return;
+                    }
+                }
             }
-            return;
+
+            restart(lane);
         }
     }
 }
@@ -181,7 +690,12 @@ MainResult KangarooAlgorithm::solve_dlp_map_parallel(mpz_class h) {
 
     // Launch threads
     for (int j = 0; j < num_threads; ++j) {
-        threads.emplace_back(&KangarooAlgorithm::solve_dlp_map_parallel_function, this, h, std::ref(final_result), std::ref(stopFlag), std::ref(ra), j);
+        std::visit([&](const auto &F) {
+            const uint64_t seed = mpz_class(ra.get_z_bits(64)).get_ui();
+            threads.emplace_back([&, j, seed]() {
+                solve_dlp_map_parallel_function(F, h, final_result, stopFlag, seed, j);
+            });
+        }, backend);
     }
 
     // Wait for all threads to finish
@@ -0,0 +1,168 @@
+#include <cpuid.h>
+#include <gmpxx.h>
+#include <stdexcept>
+#include <vector>
+
+#include "../headers/lanes.h"
+
+namespace {
+    mpz_class raw_value(const Fp256::Element &x) {
+        mpz_class result;
+        mpz_import(result.get_mpz_t(), 4, -1, sizeof(uint64_t), 0, 0, x.v);
+        return result;
+    }
+}
+
+void to_radix(const Fp256::Element &x, int bits, int limbs, uint64_t* out, int stride) {
+    const uint64_t mask = (uint64_t(1) << bits) - 1;
+    for (int j = 0; j < limbs; ++j) {
+        const int pos = j * bits, word = pos / 64, shift = pos % 64;
+        uint64_t value = 0;
+        if (word < 4) {
+            value = x.v[word] >> shift;
+            if (shift && word + 1 < 4) value |= x.v[word + 1] << (64 - shift);
+        }
+        out[j * stride] = value & mask;
+    }
+}
+
+Fp256::Element from_radix(const uint64_t* in, int bits, int limbs, int stride) {
+    Fp256::Element x = {{0, 0, 0, 0}};
+    for (int j = 0; j < limbs; ++j) {
+        const int pos = j * bits, word = pos / 64, shift = pos % 64;
+        const uint64_t value = in[j * stride];
+        if (word < 4) x.v[word] |= value << shift;
+        if (shift && shift + bits > 64 && word + 1 < 4) x.v[word + 1] |= value >> (64 - shift);
+    }
+    return x;
+}
+
+RadixJumpTable::RadixJumpTable(const Fp256 &F, const LaneJumps<Fp256::Element> &jumps, int bits, int limbs)
+        : bits(bits), limbs(limbs), R(jumps.R), s(limbs * jumps.R), slog_lo(jumps.R), slog_hi(jumps.R),
+          narrow(jumps.narrow), p(limbs), q(limbs) {
+    Fp256::Element modulus = {{F.p[0], F.p[1], F.p[2], F.p[3]}};
+    mpz_class p_value = raw_value(modulus);
+    const int extra = bits * limbs - 256;
+
+    for (long h = 0; h < R; ++h) {
+        mpz_class adjusted = (raw_value(jumps.table[h].s) << extra) % p_value;
+        Fp256::Element x;
+        mpz_export(x.v, nullptr, -1, sizeof(uint64_t), 0, 0, adjusted.get_mpz_t());
+        for (size_t k = mpz_size(adjusted.get_mpz_t()); k < 4; ++k) x.v[k] = 0;
+        to_radix(x, bits, limbs, s.data() + h, R);
+
+        slog_lo[h] = (uint64_t) jumps.table[h].slog;
+        slog_hi[h] = (uint64_t) (jumps.table[h].slog >> 64);
+    }
+
+    to_radix(modulus, bits, limbs, p.data(), 1);
+    mpz_class q_value = (mpz_class(1) << (bits * limbs)) - p_value;
+    const uint64_t mask = (uint64_t(1) << bits) - 1;
+    for (int j = 0; j < limbs; ++j) {
+        mpz_class limb = (q_value >> (j * bits)) & mpz_class(mask);
+        q[j] = mpz_get_ui(limb.get_mpz_t());
+    }
+
+    n0 = F.n0 & mask;
+}
+
+namespace {
+    struct CpuFeatures {
+        bool bmi2 = false;
+        bool adx = false;
+        bool avx2 = false;
+        bool avx512ifma = false;
+    };
+
+    CpuFeatures detect_cpu_features() {
+        CpuFeatures features;
+        unsigned int eax, ebx, ecx, edx;
+        if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx)) return features;
+        const bool osxsave = (ecx >> 27) & 1;
+
+        if (!__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx)) return features;
+        features.bmi2 = (ebx >> 8) & 1;
+        features.adx = (ebx >> 19) & 1;
+
+        // The vector kernels also need the OS to save the YMM (and for AVX-512 the opmask and ZMM) registers
+        uint64_t xcr0 = 0;
+        if (osxsave) {
+            unsigned int lo, hi;
+            __asm__("xgetbv" : "=a"(lo), "=d"(hi) : "c"(0));
+            xcr0 = ((uint64_t) hi << 32) | lo;
+        }
+        const bool ymm_state = (xcr0 & 0x6) == 0x6;
+        const bool zmm_state = (xcr0 & 0xe6) == 0xe6;
+        features.avx2 = ymm_state && ((ebx >> 5) & 1);
+        features.avx512ifma = zmm_state && ((ebx >> 16) & 1) && ((ebx >> 21) & 1);
+
+        return features;
+    }
+
+    const CpuFeatures& cpu_features() {
+        static const CpuFeatures features = detect_cpu_features();
+        return features;
+    }
+
+    bool kernel_selected = false;
+    KernelKind kernel = KERNEL_GENERIC;
+
+    // AVX-512 IFMA is the fastest by far; a MULX walk is faster than the 26-bit AVX2 lanes on the CPUs we measured
+    KernelKind best_kernel() {
+        for (KernelKind kind : {KERNEL_AVX512, KERNEL_MULX, KERNEL_AVX2}) {
+            if (cpu_supports_kernel(kind)) return kind;
+        }
+        return KERNEL_GENERIC;
+    }
+}
+
+const char* kernel_kind_name(KernelKind kind) {
+    switch (kind) {
+        case KERNEL_MULX:
+            return "mulx";
+        case KERNEL_AVX2:
+            return "avx2";
+        case KERNEL_AVX512:
+            return "avx512";
+        default:
+            return "generic";
+    }
+}
+
+bool cpu_supports_kernel(KernelKind kind) {
+    const CpuFeatures& features = cpu_features();
+    switch (kind) {
+        case KERNEL_MULX:
+            return features.bmi2 && features.adx;
+        case KERNEL_AVX2:
+            return features.avx2;
+        case KERNEL_AVX512:
+            return features.avx512ifma;
+        default:
+            return true;
+    }
+}
+
+KernelKind select_kernel(const std::string &override_name) {
+    if (override_name.empty() || override_name == "auto") {
+        kernel = best_kernel();
+    } else {
+        bool found = false;
+        for (KernelKind kind : {KERNEL_GENERIC, KERNEL_MULX, KERNEL_AVX2, KERNEL_AVX512}) {
+            if (override_name == kernel_kind_name(kind)) {
+                kernel = kind;
+                found = true;
+            }
+        }
+        if (!found) throw std::invalid_argument("unknown kernel " + override_name);
+        if (!cpu_supports_kernel(kernel)) throw std::invalid_argument("kernel " + override_name + " is not supported by this CPU");
+    }
+
+    kernel_selected = true;
+    return kernel;
+}
+
+KernelKind selected_kernel() {
+    if (!kernel_selected) return best_kernel();
+    return kernel;
+}
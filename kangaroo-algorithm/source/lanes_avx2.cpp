@@ -0,0 +1,152 @@
+#include <immintrin.h>
+#include <memory>
+
+#include "../headers/lanes.h"
+
+namespace {
+    // 10 x 26-bit limbs: every 32 x 32-bit product of two limbs fits a 64-bit lane with room for the sums.
+    constexpr int BITS = 26;
+    constexpr int LIMBS = 10;
+    // Two groups of 4 lanes so the groups' multiplications overlap.
+    constexpr int GROUPS = 2;
+    constexpr int LANES = 4 * GROUPS;
+
+    class Avx2LaneKernel : public LaneKernel<Fp256::Element> {
+    public:
+        Avx2LaneKernel(const Fp256 &F, const LaneJumps<Fp256::Element> &jumps)
+                : table(F, jumps, BITS, LIMBS), W(jumps.W) {
+            Fp256::Element one = F.from_mpz(1);
+            for (int lane = 0; lane < LANES; ++lane) set_lane(lane, one);
+        }
+
+        const char* name() const override { return kernel_kind_name(KERNEL_AVX2); }
+
+        int lanes() const override { return LANES; }
+
+        void set_lane(int lane, const Fp256::Element &x) override {
+            to_radix(x, BITS, LIMBS, &w[0][lane], LANES);
+            sum_lo[lane] = 0;
+            sum_hi[lane] = 0;
+            steps[lane] = 0;
+        }
+
+        Fp256::Element get_lane(int lane) const override { return from_radix(&w[0][lane], BITS, LIMBS, LANES); }
+
+        uint128_t lane_jumps(int lane) const override { return ((uint128_t) sum_hi[lane] << 64) | sum_lo[lane]; }
+
+        long lane_steps(int lane) const override { return (long) steps[lane]; }
+
+        uint64_t run(long max_steps) override;
+
+    private:
+        RadixJumpTable table;
+        long W;
+        alignas(32) uint64_t w[LIMBS][LANES];
+        alignas(32) uint64_t sum_lo[LANES];
+        alignas(32) uint64_t sum_hi[LANES];
+        alignas(32) uint64_t steps[LANES];
+    };
+
+    __attribute__((target("avx2")))
+    inline __m256i label_of(const uint64_t (*w)[LANES], int offset) {
+        __m256i l0 = _mm256_load_si256((const __m256i*) &w[0][offset]);
+        __m256i l1 = _mm256_load_si256((const __m256i*) &w[1][offset]);
+        __m256i l2 = _mm256_load_si256((const __m256i*) &w[2][offset]);
+        return _mm256_or_si256(l0, _mm256_or_si256(_mm256_slli_epi64(l1, BITS), _mm256_slli_epi64(l2, 2 * BITS)));
+    }
+
+    __attribute__((target("avx2")))
+    uint64_t Avx2LaneKernel::run(long max_steps) {
+        const __m256i zero = _mm256_setzero_si256();
+        const __m256i mask = _mm256_set1_epi64x((1LL << BITS) - 1);
+        const __m256i d_mask = _mm256_set1_epi64x(W - 1);
+        const __m256i r_mask = _mm256_set1_epi64x(table.R - 1);
+        const __m256i max = _mm256_set1_epi64x(max_steps);
+        const __m256i one = _mm256_set1_epi64x(1);
+        const __m256i sign = _mm256_set1_epi64x(0x8000000000000000LL);
+        const __m256i n0 = _mm256_set1_epi64x(table.n0);
+        const long long* slog_lo = (const long long*) table.slog_lo.data();
+        const long long* slog_hi = (const long long*) table.slog_hi.data();
+
+        while (true) {
+            // Distinguished and step limit tests, then the jump indices, for all lanes at once
+            __m256i idx[GROUPS];
+            uint64_t stopped = 0;
+            for (int g = 0; g < GROUPS; ++g) {
+                __m256i label = label_of(w, 4 * g);
+                __m256i dist = _mm256_cmpeq_epi64(_mm256_and_si256(label, d_mask), zero);
+                __m256i st = _mm256_load_si256((const __m256i*) &steps[4 * g]);
+                __m256i running = _mm256_cmpgt_epi64(max, st);
+                __m256i stop = _mm256_or_si256(dist, _mm256_andnot_si256(running, _mm256_set1_epi64x(-1)));
+                stopped |= (uint64_t) _mm256_movemask_pd(_mm256_castsi256_pd(stop)) << (4 * g);
+                idx[g] = _mm256_and_si256(label, r_mask);
+            }
+            if (stopped) return stopped;
+
+            for (int g = 0; g < GROUPS; ++g) {
+                const int offset = 4 * g;
+                __m256i a[LIMBS], b[LIMBS], t[LIMBS];
+                for (int j = 0; j < LIMBS; ++j) {
+                    a[j] = _mm256_load_si256((const __m256i*) &w[j][offset]);
+                    b[j] = _mm256_i64gather_epi64((const long long*) table.s.data() + j * table.R, idx[g], 8);
+                    t[j] = zero;
+                }
+
+                // Montgomery multiplication by 2^-260, one 26-bit limb of a per round
+                for (int i = 0; i < LIMBS; ++i) {
+                    for (int j = 0; j < LIMBS; ++j) t[j] = _mm256_add_epi64(t[j], _mm256_mul_epu32(a[i], b[j]));
+                    __m256i m = _mm256_and_si256(_mm256_mul_epu32(t[0], n0), mask);
+                    for (int j = 0; j < LIMBS; ++j) {
+                        t[j] = _mm256_add_epi64(t[j], _mm256_mul_epu32(m, _mm256_set1_epi64x(table.p[j])));
+                    }
+                    __m256i carry = _mm256_srli_epi64(t[0], BITS);
+                    for (int j = 0; j < LIMBS - 1; ++j) t[j] = t[j + 1];
+                    t[LIMBS - 1] = zero;
+                    t[0] = _mm256_add_epi64(t[0], carry);
+                }
+
+                // Normalize the limbs; the value is below 2p
+                for (int j = 0; j < LIMBS - 1; ++j) {
+                    t[j + 1] = _mm256_add_epi64(t[j + 1], _mm256_srli_epi64(t[j], BITS));
+                    t[j] = _mm256_and_si256(t[j], mask);
+                }
+
+                // u = t + 2^260 - p overflows 2^260 exactly when t >= p, then u mod 2^260 = t - p
+                __m256i u[LIMBS];
+                __m256i carry = zero;
+                for (int j = 0; j < LIMBS; ++j) {
+                    u[j] = _mm256_add_epi64(_mm256_add_epi64(t[j], _mm256_set1_epi64x(table.q[j])), carry);
+                    carry = _mm256_srli_epi64(u[j], BITS);
+                    u[j] = _mm256_and_si256(u[j], mask);
+                }
+                __m256i keep = _mm256_cmpeq_epi64(carry, zero);
+                for (int j = 0; j < LIMBS; ++j) {
+                    __m256i r = _mm256_blendv_epi8(u[j], t[j], keep);
+                    _mm256_store_si256((__m256i*) &w[j][offset], r);
+                }
+
+                // Exponent sums, 64-bit when they cannot carry and 128-bit otherwise, and step counters
+                __m256i lo = _mm256_load_si256((const __m256i*) &sum_lo[offset]);
+                __m256i add_lo = _mm256_i64gather_epi64(slog_lo, idx[g], 8);
+                __m256i new_lo = _mm256_add_epi64(lo, add_lo);
+                _mm256_store_si256((__m256i*) &sum_lo[offset], new_lo);
+                if (!table.narrow) {
+                    __m256i hi = _mm256_load_si256((const __m256i*) &sum_hi[offset]);
+                    __m256i add_hi = _mm256_i64gather_epi64(slog_hi, idx[g], 8);
+                    __m256i wrapped = _mm256_cmpgt_epi64(_mm256_xor_si256(add_lo, sign), _mm256_xor_si256(new_lo, sign));
+                    hi = _mm256_sub_epi64(_mm256_add_epi64(hi, add_hi), wrapped);
+                    _mm256_store_si256((__m256i*) &sum_hi[offset], hi);
+                }
+
+                __m256i st = _mm256_load_si256((const __m256i*) &steps[offset]);
+                _mm256_store_si256((__m256i*) &steps[offset], _mm256_add_epi64(st, one));
+            }
+        }
+    }
+}
+
+std::unique_ptr<LaneKernel<Fp256::Element>> make_avx2_lane_kernel(const Fp256 &F, const LaneJumps<Fp256::Element> &jumps) {
+    if (!cpu_supports_kernel(KERNEL_AVX2)) return nullptr;
+
+    return std::unique_ptr<LaneKernel<Fp256::Element>>(new Avx2LaneKernel(F, jumps));
+}
@@ -0,0 +1,150 @@
+#include <immintrin.h>
+#include <memory>
+
+#include "../headers/lanes.h"
+
+namespace {
+    // 5 x 52-bit limbs for the AVX-512 IFMA 52-bit multiply-add instructions.
+    constexpr int BITS = 52;
+    constexpr int LIMBS = 5;
+    // Two groups of 8 lanes so the groups' multiply-add chains overlap.
+    constexpr int GROUPS = 2;
+    constexpr int LANES = 8 * GROUPS;
+
+    class IfmaLaneKernel : public LaneKernel<Fp256::Element> {
+    public:
+        IfmaLaneKernel(const Fp256 &F, const LaneJumps<Fp256::Element> &jumps)
+                : table(F, jumps, BITS, LIMBS), W(jumps.W) {
+            Fp256::Element one = F.from_mpz(1);
+            for (int lane = 0; lane < LANES; ++lane) set_lane(lane, one);
+        }
+
+        const char* name() const override { return kernel_kind_name(KERNEL_AVX512); }
+
+        int lanes() const override { return LANES; }
+
+        void set_lane(int lane, const Fp256::Element &x) override {
+            to_radix(x, BITS, LIMBS, &w[0][lane], LANES);
+            sum_lo[lane] = 0;
+            sum_hi[lane] = 0;
+            steps[lane] = 0;
+        }
+
+        Fp256::Element get_lane(int lane) const override { return from_radix(&w[0][lane], BITS, LIMBS, LANES); }
+
+        uint128_t lane_jumps(int lane) const override { return ((uint128_t) sum_hi[lane] << 64) | sum_lo[lane]; }
+
+        long lane_steps(int lane) const override { return (long) steps[lane]; }
+
+        uint64_t run(long max_steps) override;
+
+    private:
+        RadixJumpTable table;
+        long W;
+        alignas(64) uint64_t w[LIMBS][LANES];
+        alignas(64) uint64_t sum_lo[LANES];
+        alignas(64) uint64_t sum_hi[LANES];
+        alignas(64) uint64_t steps[LANES];
+    };
+
+    __attribute__((target("avx512f,avx512ifma")))
+    uint64_t IfmaLaneKernel::run(long max_steps) {
+        const __m512i zero = _mm512_setzero_si512();
+        const __m512i mask = _mm512_set1_epi64((1LL << BITS) - 1);
+        const __m512i d_mask = _mm512_set1_epi64(W - 1);
+        const __m512i r_mask = _mm512_set1_epi64(table.R - 1);
+        const __m512i max = _mm512_set1_epi64(max_steps);
+        const __m512i one = _mm512_set1_epi64(1);
+        const __m512i n0 = _mm512_set1_epi64(table.n0);
+        __m512i p[LIMBS], q[LIMBS];
+        for (int j = 0; j < LIMBS; ++j) {
+            p[j] = _mm512_set1_epi64(table.p[j]);
+            q[j] = _mm512_set1_epi64(table.q[j]);
+        }
+
+        while (true) {
+            // Distinguished and step limit tests, then the jump indices, for all lanes at once
+            __m512i idx[GROUPS];
+            uint64_t stopped = 0;
+            for (int g = 0; g < GROUPS; ++g) {
+                __m512i l0 = _mm512_load_si512(&w[0][8 * g]);
+                __m512i l1 = _mm512_load_si512(&w[1][8 * g]);
+                __m512i label = _mm512_or_si512(l0, _mm512_slli_epi64(l1, BITS));
+                __mmask8 dist = _mm512_testn_epi64_mask(label, d_mask);
+                __mmask8 limit = _mm512_cmpge_epi64_mask(_mm512_load_si512(&steps[8 * g]), max);
+                stopped |= (uint64_t) (uint8_t) (dist | limit) << (8 * g);
+                idx[g] = _mm512_and_si512(label, r_mask);
+            }
+            if (stopped) return stopped;
+
+            for (int g = 0; g < GROUPS; ++g) {
+                const int offset = 8 * g;
+                __m512i a[LIMBS], b[LIMBS], t[LIMBS + 1];
+                for (int j = 0; j < LIMBS; ++j) {
+                    a[j] = _mm512_load_si512(&w[j][offset]);
+                    b[j] = _mm512_i64gather_epi64(idx[g], table.s.data() + j * table.R, 8);
+                    t[j] = zero;
+                }
+                t[LIMBS] = zero;
+
+                // Montgomery multiplication by 2^-260, one 52-bit limb of a per round
+                for (int i = 0; i < LIMBS; ++i) {
+                    for (int j = 0; j < LIMBS; ++j) {
+                        t[j] = _mm512_madd52lo_epu64(t[j], a[i], b[j]);
+                        t[j + 1] = _mm512_madd52hi_epu64(t[j + 1], a[i], b[j]);
+                    }
+                    __m512i m = _mm512_madd52lo_epu64(zero, t[0], n0);
+                    for (int j = 0; j < LIMBS; ++j) {
+                        t[j] = _mm512_madd52lo_epu64(t[j], m, p[j]);
+                        t[j + 1] = _mm512_madd52hi_epu64(t[j + 1], m, p[j]);
+                    }
+                    __m512i carry = _mm512_srli_epi64(t[0], BITS);
+                    for (int j = 0; j < LIMBS; ++j) t[j] = t[j + 1];
+                    t[LIMBS] = zero;
+                    t[0] = _mm512_add_epi64(t[0], carry);
+                }
+
+                // Normalize the limbs; the value is below 2p
+                for (int j = 0; j < LIMBS - 1; ++j) {
+                    t[j + 1] = _mm512_add_epi64(t[j + 1], _mm512_srli_epi64(t[j], BITS));
+                    t[j] = _mm512_and_si512(t[j], mask);
+                }
+
+                // u = t + 2^260 - p overflows 2^260 exactly when t >= p, then u mod 2^260 = t - p
+                __m512i u[LIMBS];
+                __m512i carry = zero;
+                for (int j = 0; j < LIMBS; ++j) {
+                    u[j] = _mm512_add_epi64(_mm512_add_epi64(t[j], q[j]), carry);
+                    carry = _mm512_srli_epi64(u[j], BITS);
+                    u[j] = _mm512_and_si512(u[j], mask);
+                }
+                __mmask8 reduce = _mm512_test_epi64_mask(carry, carry);
+                for (int j = 0; j < LIMBS; ++j) {
+                    _mm512_store_si512(&w[j][offset], _mm512_mask_blend_epi64(reduce, t[j], u[j]));
+                }
+
+                // Exponent sums, 64-bit when they cannot carry and 128-bit otherwise, and step counters
+                __m512i lo = _mm512_load_si512(&sum_lo[offset]);
+                __m512i add_lo = _mm512_i64gather_epi64(idx[g], table.slog_lo.data(), 8);
+                __m512i new_lo = _mm512_add_epi64(lo, add_lo);
+                _mm512_store_si512(&sum_lo[offset], new_lo);
+                if (!table.narrow) {
+                    __m512i hi = _mm512_load_si512(&sum_hi[offset]);
+                    __m512i add_hi = _mm512_i64gather_epi64(idx[g], table.slog_hi.data(), 8);
+                    __mmask8 wrapped = _mm512_cmplt_epu64_mask(new_lo, add_lo);
+                    hi = _mm512_mask_add_epi64(_mm512_add_epi64(hi, add_hi), wrapped, _mm512_add_epi64(hi, add_hi), one);
+                    _mm512_store_si512(&sum_hi[offset], hi);
+                }
+
+                __m512i st = _mm512_load_si512(&steps[offset]);
+                _mm512_store_si512(&steps[offset], _mm512_add_epi64(st, one));
+            }
+        }
+    }
+}
+
+std::unique_ptr<LaneKernel<Fp256::Element>> make_ifma_lane_kernel(const Fp256 &F, const LaneJumps<Fp256::Element> &jumps) {
+    if (!cpu_supports_kernel(KERNEL_AVX512)) return nullptr;
+
+    return std::unique_ptr<LaneKernel<Fp256::Element>>(new IfmaLaneKernel(F, jumps));
+}
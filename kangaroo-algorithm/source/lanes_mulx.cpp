@@ -0,0 +1,68 @@
+#include <immintrin.h>
+
+#include "../headers/lanes.h"
+
+// Same CIOS schedule as Fp256::mul. In every row the low halves of the products are added on the CF chain (ADCX)
+// and the high halves on the OF chain (ADOX), so the two chains are independent.
+__attribute__((target("bmi2,adx")))
+void Fp256Mulx::mul(Element &r, const Element &a, const Element &b) const {
+    typedef unsigned long long u64;
+
+    u64 t0 = 0, t1 = 0, t2 = 0, t3 = 0, t4 = 0, t5;
+    u64 l0, l1, l2, l3, h0, h1, h2, h3;
+    unsigned char c, o;
+    for (int i = 0; i < 4; ++i) {
+        const u64 ai = a.v[i];
+
+        l0 = _mulx_u64(ai, b.v[0], &h0);
+        l1 = _mulx_u64(ai, b.v[1], &h1);
+        l2 = _mulx_u64(ai, b.v[2], &h2);
+        l3 = _mulx_u64(ai, b.v[3], &h3);
+        c = _addcarryx_u64(0, t0, l0, &t0);
+        c = _addcarryx_u64(c, t1, l1, &t1);
+        c = _addcarryx_u64(c, t2, l2, &t2);
+        c = _addcarryx_u64(c, t3, l3, &t3);
+        c = _addcarryx_u64(c, t4, 0, &t4);
+        t5 = c;
+        o = _addcarryx_u64(0, t1, h0, &t1);
+        o = _addcarryx_u64(o, t2, h1, &t2);
+        o = _addcarryx_u64(o, t3, h2, &t3);
+        o = _addcarryx_u64(o, t4, h3, &t4);
+        t5 += o;
+
+        const u64 m = t0 * n0;
+        l0 = _mulx_u64(m, p[0], &h0);
+        l1 = _mulx_u64(m, p[1], &h1);
+        l2 = _mulx_u64(m, p[2], &h2);
+        l3 = _mulx_u64(m, p[3], &h3);
+        // t0 + l0 is 0 mod 2^64, only its carry is needed
+        c = _addcarryx_u64(0, t0, l0, &t0);
+        c = _addcarryx_u64(c, t1, l1, &t1);
+        c = _addcarryx_u64(c, t2, l2, &t2);
+        c = _addcarryx_u64(c, t3, l3, &t3);
+        c = _addcarryx_u64(c, t4, 0, &t4);
+        t5 += c;
+        o = _addcarryx_u64(0, t1, h0, &t1);
+        o = _addcarryx_u64(o, t2, h1, &t2);
+        o = _addcarryx_u64(o, t3, h2, &t3);
+        o = _addcarryx_u64(o, t4, h3, &t4);
+        t5 += o;
+
+        t0 = t1; t1 = t2; t2 = t3; t3 = t4; t4 = t5;
+    }
+
+    // The result is below 2p, one conditional subtraction brings it into [0, p)
+    u64 s0, s1, s2, s3, s4;
+    unsigned char borrow;
+    borrow = _subborrow_u64(0, t0, p[0], &s0);
+    borrow = _subborrow_u64(borrow, t1, p[1], &s1);
+    borrow = _subborrow_u64(borrow, t2, p[2], &s2);
+    borrow = _subborrow_u64(borrow, t3, p[3], &s3);
+    borrow = _subborrow_u64(borrow, t4, 0, &s4);
+    // Keep t only when the subtraction borrowed, i.e. t < p
+    const u64 keep = 0 - (u64) borrow;
+    r.v[0] = (t0 & keep) | (s0 & ~keep);
+    r.v[1] = (t1 & keep) | (s1 & ~keep);
+    r.v[2] = (t2 & keep) | (s2 & ~keep);
+    r.v[3] = (t3 & keep) | (s3 & ~keep);
+}
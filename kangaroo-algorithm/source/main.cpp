@@ -3,24 +3,104 @@
 #include <gmpxx.h>
 #include <string>
 #include <chrono>
+#include <cmath>
+#include <filesystem>
+#include <stdexcept>
+#include <random>
+#include <map>
 
 #include "../headers/secrets.h"
 #include "../headers/table.h"
 #include "../headers/logger.h"
 #include "../headers/arguments.h"
 #include "../headers/kangaroo.h"
+#include "../headers/params.h"
+#include "../headers/lanes.h"
 
 using std::cout;
 using std::flush;
 using std::sort;
 using std::lower_bound;
 
+// Size and write rate of a file written in the given time
+std::string write_rate(const std::string& path, std::chrono::high_resolution_clock::duration spent) {
+    const double bytes = std::filesystem::file_size(path);
+    const double seconds = std::chrono::duration<double>(spent).count();
+    return std::to_string((size_t) bytes) + " bytes in " +
+           std::to_string(std::chrono::duration_cast<std::chrono::milliseconds>(spent).count()) + " millis, " +
+           std::to_string(seconds > 0 ? bytes / seconds / 1e6 : 0.0) + " MB/s";
+}
+
+// Points of a merge by their hits in power-of-two ranges keyed by the lower end, all of them or the kept ones
+std::map<long long, long long> merged_hit_histogram(const TableMergeResult& merged, bool kept) {
+    std::map<long long, long long> histogram;
+    for (const auto& pair : merged.by_hits) {
+        size_t points = pair.second;
+        if (kept && pair.first < merged.min_hits) points = 0;
+        if (kept && pair.first == merged.min_hits) points = merged.kept_at_min;
+        if (!points) continue;
+
+        long long low = 1;
+        while (2 * low <= (long long) pair.first) low *= 2;
+        histogram[low] += points;
+    }
+    return histogram;
+}
+
 mpz_class p("109058979322431746959182812013517394520037958891193115336877067190430268203759");
 
-int main(int argc, char *argv[])
+int run(int argc, char *argv[])
 {
     ParsedArgs parsed = parse_args(argc, argv);
 
+    std::string log_path = parsed.log_path;
+    init_logger(log_path);
+
+    // The hardcoded p is used unless group parameters are given by a file or by the command line
+    GroupParams group;
+    group.p = p;
+    std::string group_source = "built-in parameters";
+    if (!parsed.group_params_path.empty()) {
+        group = read_group_params(parsed.group_params_path);
+        group_source = "parameters from " + parsed.group_params_path;
+    }
+    if (!parsed.group_curve.empty()) {
+        group = curve_group_params(parsed.group_curve);
+        group_source = "built-in curve parameters";
+    }
+    group.negation_map = !parsed.no_negation_map;
+    if (!parsed.group_p.empty() || !parsed.group_g.empty() || !parsed.group_order.empty()) {
+        if (!parsed.group_p.empty()) group.p = mpz_class(parsed.group_p, 0);
+        if (!parsed.group_g.empty()) group.g = mpz_class(parsed.group_g, 0);
+        if (!parsed.group_order.empty()) group.order = mpz_class(parsed.group_order, 0);
+        group_source += " with command line overrides";
+    }
+    validate_group_params(group);
+
+    // The step kernel is picked once, before any walk starts
+    select_kernel(parsed.kernel);
+
+    const bool packed_table = parsed.table_format == "packed";
+    if (!packed_table && !parsed.table_format.empty() && parsed.table_format != "mapped") {
+        throw std::invalid_argument("unknown table format " + parsed.table_format + ", use mapped or packed");
+    }
+    const bool perfect_index = parsed.table_index == "perfect";
+    if (!perfect_index && !parsed.table_index.empty() && parsed.table_index != "buckets") {
+        throw std::invalid_argument("unknown table index " + parsed.table_index + ", use buckets or perfect");
+    }
+    if (perfect_index && (parsed.table_key_bits || parsed.table_log_bits)) {
+        throw std::invalid_argument("the perfect hash index needs the full table, not a compressed one");
+    }
+    if (parsed.table_shard && !parsed.allow_write_table) {
+        throw std::invalid_argument("shards are generated, use -t 1");
+    }
+    if (parsed.memory_budget && parsed.table_shard) {
+        throw std::invalid_argument("shards keep all their candidates in memory, drop --memory-budget");
+    }
+    if (!parsed.coordinator_address.empty() && !parsed.allow_write_table) {
+        throw std::invalid_argument("the coordinator generates the table, use -t 1");
+    }
+
     auto algo = new KangarooAlgorithm(
             parsed.n,
             parsed.w,
@@ -28,13 +108,40 @@ int main(int argc, char *argv[])
             parsed.i,
             parsed.m,
             parsed.r,
-            p
+            group
     );
 
     algo->init_s();
 
-    std::string log_path = parsed.log_path;
-    init_logger(log_path);
+    if (!parsed.worker_address.empty()) {
+        log("Walking for the coordinator at " + parsed.worker_address);
+        auto worker_start = std::chrono::high_resolution_clock::now();
+        long long worker_steps = 0;
+        try {
+            worker_steps = algo->run_worker(parsed.worker_address);
+        } catch (const std::runtime_error& e) {
+            log("Worker stopped: " + std::string(e.what()));
+            return 1;
+        }
+        auto worker_end = std::chrono::high_resolution_clock::now();
+        log("The coordinator's table is full, " + std::to_string(worker_steps) + " steps in " +
+            std::to_string(std::chrono::duration_cast<std::chrono::milliseconds>(worker_end - worker_start).count()) +
+            " millis");
+        return 0;
+    }
+
+    if (!parsed.merge_tables.empty()) {
+        auto merge_start = std::chrono::high_resolution_clock::now();
+        TableMergeResult merged = merge_tables(parsed.merge_tables, parsed.n, parsed.table_path);
+        auto merge_end = std::chrono::high_resolution_clock::now();
+        log("Merged " + std::to_string(parsed.merge_tables.size()) + " files into " + parsed.table_path + ": " +
+            std::to_string(merged.read) + " entries read, " + std::to_string(merged.distinct) + " distinct points, " +
+            std::to_string(merged.kept) + " kept with at least " + std::to_string(merged.min_hits) + " hits, " +
+            std::to_string(std::filesystem::file_size(parsed.table_path)) + " bytes in " +
+            std::to_string(std::chrono::duration_cast<std::chrono::milliseconds>(merge_end - merge_start).count()) +
+            " millis");
+        return 0;
+    }
 
     SecretsData secrets = read_secrets(parsed.secret_path);
     double l_float = algo -> l.get_d();
@@ -48,11 +155,51 @@ int main(int argc, char *argv[])
     log("i: " + std::to_string(algo -> i));
     log("alpha = " + std::to_string(algo -> W / std::sqrt(l_float / algo -> T)));
     log("Secret size: " + std::to_string(parsed.secret_size) + " bits");
+    log("Group: " + (group.curve.empty() ? "" : group.curve + " curve, ") +
+        std::to_string(mpz_sizeinbase(algo -> p.get_mpz_t(), 2)) + "-bit p, " + group_source +
+        (algo -> order != 0 ? ", order of g is " + std::to_string(mpz_sizeinbase(algo -> order.get_mpz_t(), 2)) + " bits" : ""));
+    log("Group backend: " + backend_name(algo -> backend));
+    log("Jump table: " + std::to_string(algo -> R) + " entries of " + std::to_string(algo -> jump_entry_size()) +
+        " bytes, " + std::to_string(algo -> R * algo -> jump_entry_size()) + " bytes per thread, 64-byte aligned");
+    log("Lane kernel: " + algo -> lane_kernel_name() + (parsed.kernel.empty() ? " (detected)" : " (--kernel " + parsed.kernel + ")"));
     log("Logs will be stored into: " + parsed.log_path);
 
     gmp_randclass ra(gmp_randinit_default);
 
     if (parsed.allow_write_table) {
+        // Checkpoints sit next to the table and are removed once it is written
+        algo -> checkpoint_path = parsed.table_path + ".checkpoint";
+        algo -> checkpoint_interval = parsed.checkpoint_interval;
+        algo -> shard = parsed.table_shard;
+        algo -> coordinator_address = parsed.coordinator_address;
+        algo -> memory_budget = (size_t) parsed.memory_budget << 20;
+        algo -> spill_prefix = parsed.table_path + ".run";
+        if (parsed.memory_budget) {
+            log("Memory budget: " + std::to_string(parsed.memory_budget) + " MB, runs of " +
+                std::to_string(algo->spill_run_size()) + " points are spilled to " + algo -> spill_prefix + "<n>");
+        }
+        if (!parsed.coordinator_address.empty()) {
+            log("Taking distinguished points from workers at " + parsed.coordinator_address);
+        }
+        if (parsed.resume && std::filesystem::exists(algo -> checkpoint_path)) {
+            const std::string error = algo->resume_table(algo -> checkpoint_path);
+            if (!error.empty()) {
+                log("Cannot resume: " + error);
+                return 1;
+            }
+            log("Resuming from " + algo -> checkpoint_path + ": " + std::to_string(algo -> table.size()) + " entries, " +
+                std::to_string(algo -> generation.spilled_entries) + " more in " +
+                std::to_string(algo -> generation.spilled_runs) + " spilled runs, " +
+                std::to_string(algo -> generation.numsteps) + " steps, " + std::to_string(algo -> generation.runs) +
+                " runs before, jump table restored");
+        } else if (parsed.resume) {
+            log("No checkpoint at " + algo -> checkpoint_path + ", starting a new table");
+        }
+        if (parsed.checkpoint_interval > 0) {
+            log("Checkpoints every " + std::to_string(parsed.checkpoint_interval) + " seconds into " +
+                algo -> checkpoint_path);
+        }
+
         // Do preprocessing and generate a new table
         log("Preprocessing started. The table will be stored into " + parsed.table_path);
 
@@ -64,24 +211,147 @@ int main(int argc, char *argv[])
         auto preprocessing_end = std::chrono::high_resolution_clock::now();
         log("Preprocessing complete with time: " + std::to_string(std::chrono::duration_cast<std::chrono::milliseconds>(preprocessing_end - preprocessing_start).count()) + " millis");
 
-        log("Distinguished repeating points counter:");
-        if (!res.distinguishedCounter.empty()) {
-            for (const auto& pair : res.distinguishedCounter) {
-                log("point " + pair.first + " repeated " + std::to_string(pair.second) + " times;");
+        // A table spilled to runs is only counted by their merge
+        auto log_hit_histogram = [&](size_t generated_points, size_t kept_points) {
+            log("Walks per distinguished point, " + std::to_string(generated_points) + " points generated, " +
+                std::to_string(kept_points) + " kept:");
+            for (const auto& pair : res.hitHistogram) {
+                const auto kept = res.keptHistogram.find(pair.first);
+                log(std::to_string(pair.first) + (pair.first > 1 ? "-" + std::to_string(2 * pair.first - 1) : "") +
+                    " walks: " + std::to_string(pair.second) + " points, " +
+                    std::to_string(kept != res.keptHistogram.end() ? kept->second : 0) + " kept");
             }
-        } else {
-            log("no repeated distinguished points found");
-        }
+        };
+        if (!algo -> generation.spilled_runs) log_hit_histogram(res.candidates, algo -> table.size());
 
         log(std::to_string(res.numsteps) + " precomputation steps; ");
-        auto is_table_written = algo->tableMap.writeToFile(parsed.table_path);
+
+        if (parsed.table_shard) {
+            // All candidates with their hits, the table is selected when the shards are merged
+            algo -> generation.numsteps = res.numsteps;
+            algo -> generation.params = algo->table_params();
+            auto shard_start = std::chrono::high_resolution_clock::now();
+            if (!algo->table.writeCheckpoint(parsed.table_path, algo -> generation, true)) {
+                log("Shard " + std::to_string(parsed.table_shard) + " could not be written");
+                return 1;
+            }
+            auto shard_end = std::chrono::high_resolution_clock::now();
+            std::filesystem::remove(algo -> checkpoint_path);
+            log("Shard " + std::to_string(parsed.table_shard) + " written: " + std::to_string(algo -> table.size()) +
+                " points with their hits, " + write_rate(parsed.table_path, shard_end - shard_start));
+            return 0;
+        }
+
+        bool is_table_written;
+        auto writing_start = std::chrono::high_resolution_clock::now();
+        if (algo -> generation.spilled_runs) {
+            // The runs are merged into a table file, which is then mapped for solving
+            std::vector<std::string> runs;
+            for (uint64_t run = 0; run < algo -> generation.spilled_runs; ++run) runs.push_back(algo->spill_path(run));
+            const std::string merged_path = packed_table ? parsed.table_path + ".merged" : parsed.table_path;
+            TableMergeResult merged = merge_tables(runs, algo -> N, merged_path);
+            auto merge_end = std::chrono::high_resolution_clock::now();
+            log("Merged " + std::to_string(runs.size()) + " spilled runs: " + std::to_string(merged.read) +
+                " entries read, " + std::to_string(merged.distinct) + " distinct points, " +
+                std::to_string(merged.kept) + " kept with at least " + std::to_string(merged.min_hits) + " hits, " +
+                write_rate(merged_path, merge_end - writing_start));
+            res.hitHistogram = merged_hit_histogram(merged, false);
+            res.keptHistogram = merged_hit_histogram(merged, true);
+            log_hit_histogram(merged.distinct, merged.kept);
+            std::filesystem::remove(algo -> checkpoint_path);
+            for (const std::string& run : runs) std::filesystem::remove(run);
+
+            is_table_written = algo->frozen_table.readFromFile(merged_path);
+            if (is_table_written && packed_table) {
+                writing_start = std::chrono::high_resolution_clock::now();
+                is_table_written = algo->frozen_table.writePacked(parsed.table_path);
+                std::filesystem::remove(merged_path);
+            }
+        } else {
+            log("Table: " + std::to_string(algo -> table.size()) + " entries in " + std::to_string(algo -> table.slots.size()) +
+                " slots of " + std::to_string(sizeof(TableEntry)) + " bytes, " + std::to_string(algo -> table.memory_bytes()) +
+                " bytes");
+
+            // Solving threads only read the table, which is also the image of the table file
+            algo->freeze_table();
+
+            is_table_written = packed_table ? algo->frozen_table.writePacked(parsed.table_path)
+                                            : algo->frozen_table.writeToFile(parsed.table_path);
+        }
+        auto writing_end = std::chrono::high_resolution_clock::now();
         if (is_table_written) {
-            log("Generated table is written");
+            log("Generated table is written, " + std::string(packed_table ? "packed" : "version 3") + " format, " +
+                write_rate(parsed.table_path, writing_end - writing_start));
+            std::filesystem::remove(algo -> checkpoint_path);
         } else {
             log("Generated table is not written due to unknown error");
         }
     } else {
-        algo->tableMap.readFromFile(parsed.table_path);
+        auto loading_start = std::chrono::high_resolution_clock::now();
+        if (!algo->frozen_table.readFromFile(parsed.table_path)) {
+            log("Table " + parsed.table_path + " could not be loaded");
+            return 1;
+        }
+        auto loading_end = std::chrono::high_resolution_clock::now();
+        log("Table " + std::string(algo -> frozen_table.mapped ? "mapped" : "decoded") + " from " + parsed.table_path + " in " + std::to_string(std::chrono::duration_cast<std::chrono::microseconds>(loading_end - loading_start).count()) + " micros");
+
+        // The table only holds for the walks it was generated with: same group, interval, W and jump table
+        const std::string mismatch = algo->table_params_mismatch(algo -> frozen_table.params);
+        if (!mismatch.empty()) {
+            log("Table " + parsed.table_path + " was generated with other parameters: " + mismatch);
+            return 1;
+        }
+        algo->restore_jumps(algo -> frozen_table.params.slog);
+        log("Jump table restored from the table file");
+    }
+    log("Frozen table: " + std::to_string(algo -> frozen_table.size()) + " entries, " +
+        std::to_string(algo -> frozen_table.memory_bytes()) + " bytes" + (algo -> frozen_table.mapped ? ", mapped" : ""));
+
+    if (parsed.table_benchmark > 0) {
+        TableBenchmark bench = benchmark_table_lookups(algo -> frozen_table, parsed.table_benchmark,
+                                                        parsed.table_filter_bits);
+        log("Table benchmark, " + std::to_string(parsed.table_benchmark) + " lookups each:");
+        log("buckets: " + std::to_string(bench.frozen_hit) + " ns per hit, " + std::to_string(bench.frozen_miss) +
+            " ns per miss, " + std::to_string(algo -> frozen_table.memory_bytes()) + " bytes");
+        log("perfect: " + std::to_string(bench.perfect_hit) + " ns per hit, " + std::to_string(bench.perfect_miss) +
+            " ns per miss, " + std::to_string(bench.perfect_bytes) + " bytes, built in " +
+            std::to_string(bench.perfect_build_millis) + " millis");
+        if (parsed.table_filter_bits) {
+            log("buckets behind the filter: " + std::to_string(bench.filtered_miss) + " ns per miss");
+        }
+        return 0;
+    }
+
+    if (parsed.table_filter_bits) {
+        algo->filter_table(parsed.table_filter_bits);
+
+        // False positive rate on random fingerprints, which are almost never in the table
+        std::mt19937_64 random(1);
+        const long probes = 1000000;
+        long passed = 0;
+        for (long j = 0; j < probes; ++j) passed += algo -> table_filter.may_contain(random() | 1);
+        log("Table filter: " + std::to_string(parsed.table_filter_bits) + " bits per key, " +
+            std::to_string(algo -> table_filter.memory_bytes()) + " bytes, " +
+            std::to_string(100.0 * passed / probes) + "% false positives");
+    }
+
+    if (perfect_index) {
+        auto index_start = std::chrono::high_resolution_clock::now();
+        algo->index_table();
+        auto index_end = std::chrono::high_resolution_clock::now();
+        log("Perfect hash index: " + std::to_string(algo -> perfect_table.size()) + " entries, " +
+            std::to_string(algo -> perfect_table.memory_bytes()) + " bytes, built in " +
+            std::to_string(std::chrono::duration_cast<std::chrono::milliseconds>(index_end - index_start).count()) +
+            " millis");
+    }
+
+    if (parsed.table_key_bits || parsed.table_log_bits) {
+        algo->compress_table(parsed.table_key_bits ? parsed.table_key_bits : 64,
+                             parsed.table_log_bits ? parsed.table_log_bits : 128);
+        const CompressedTable& compressed = algo -> compressed_table;
+        log("Compressed table: " + std::to_string(compressed.key_bits) + " key bits and " +
+            std::to_string(compressed.log_bits) + " log bits per entry, " + std::to_string(compressed.memory_bytes()) +
+            " bytes, up to " + algo -> compressed_candidates().get_str() + " candidate logs per match");
     }
 
 
@@ -157,3 +427,13 @@ int main(int argc, char *argv[])
     return 0;
 }
 
+// Invalid options, group parameters and files end the run with the reason instead of an abort
+int main(int argc, char *argv[])
+{
+    try {
+        return run(argc, argv);
+    } catch (const std::exception& e) {
+        log(std::string("Error: ") + e.what());
+        return 1;
+    }
+}
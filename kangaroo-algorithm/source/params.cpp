@@ -0,0 +1,148 @@
+#include <gmpxx.h>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+
+#include "../headers/params.h"
+
+namespace {
+    std::string trim(const std::string& s) {
+        size_t begin = s.find_first_not_of(" \t\r");
+        if (begin == std::string::npos) return "";
+        size_t end = s.find_last_not_of(" \t\r");
+        return s.substr(begin, end - begin + 1);
+    }
+}
+
+GroupParams curve_group_params(const std::string& name) {
+    const CurveParams* curve = find_curve(name);
+    if (!curve) {
+        throw std::invalid_argument("Unknown curve: " + name);
+    }
+
+    GroupParams params = {};
+    params.p = curve->p;
+    params.g = encode_point(AffinePoint{curve->gx, curve->gy, false});
+    params.order = curve->n;
+    params.curve = curve->name;
+    params.a = curve->a;
+    params.b = curve->b;
+    return params;
+}
+
+CurveParams group_curve(const GroupParams& params) {
+    AffinePoint generator = decode_point(params.g);
+    return CurveParams{params.curve, params.p, params.a, params.b, generator.x, generator.y, params.order};
+}
+
+GroupParams read_group_params(const std::string& path) {
+    std::ifstream inFile(path);
+    if (!inFile) {
+        throw std::runtime_error("Could not open group parameters file " + path);
+    }
+
+    GroupParams params = {};
+    mpz_class gx = 0, gy = 0;
+    std::string line;
+    while (std::getline(inFile, line)) {
+        line = trim(line);
+        if (line.empty() || line[0] == '#') continue;
+
+        size_t eq = line.find('=');
+        if (eq == std::string::npos) {
+            throw std::runtime_error("Malformed line in group parameters file: " + line);
+        }
+
+        std::string name = trim(line.substr(0, eq));
+        if (name == "curve") {
+            params = curve_group_params(trim(line.substr(eq + 1)));
+            continue;
+        }
+
+        mpz_class value;
+        if (value.set_str(trim(line.substr(eq + 1)), 0) != 0) {
+            throw std::runtime_error("Malformed number in group parameters file: " + line);
+        }
+
+        if (name == "p") {
+            params.p = value;
+        } else if (name == "g") {
+            params.g = value;
+        } else if (name == "order") {
+            params.order = value;
+        } else if (name == "a" || name == "b" || name == "gx" || name == "gy") {
+            if (params.curve.empty()) params.curve = "custom";
+            if (name == "a") params.a = value;
+            if (name == "b") params.b = value;
+            if (name == "gx") gx = value;
+            if (name == "gy") gy = value;
+        } else {
+            throw std::runtime_error("Unknown group parameter: " + name);
+        }
+    }
+
+    if (gx != 0 || gy != 0) {
+        AffinePoint generator = decode_point(params.g);
+        if (gx != 0) generator.x = gx;
+        if (gy != 0) generator.y = gy;
+        generator.infinity = false;
+        params.g = encode_point(generator);
+    }
+
+    return params;
+}
+
+namespace {
+    void validate_curve_params(const GroupParams& params) {
+        if (mpz_sizeinbase(params.p.get_mpz_t(), 2) > 256) {
+            throw std::invalid_argument("curve groups need p of at most 256 bits");
+        }
+
+        CurveParams curve = group_curve(params);
+        mpz_class discriminant = (4 * curve.a * curve.a * curve.a + 27 * curve.b * curve.b) % curve.p;
+        // b != 0 keeps (0, 0), the encoding of the point at infinity, off the curve
+        if (discriminant == 0 || curve.b % curve.p == 0) {
+            throw std::invalid_argument("the curve must be non-singular with b != 0");
+        }
+
+        AffinePoint generator = decode_point(params.g);
+        if (generator.infinity || !on_curve(curve, generator)) {
+            throw std::invalid_argument("the generator is not a point of the curve");
+        }
+
+        if (params.order <= 1 || mpz_probab_prime_p(params.order.get_mpz_t(), 25) == 0) {
+            throw std::invalid_argument("curve groups need the prime order of the generator");
+        }
+
+        if (!curve_mul(curve, generator, params.order).infinity) {
+            throw std::invalid_argument("order * g is not the point at infinity");
+        }
+    }
+}
+
+void validate_group_params(const GroupParams& params) {
+    if (params.p <= 3 || mpz_probab_prime_p(params.p.get_mpz_t(), 25) == 0) {
+        throw std::invalid_argument("p must be a prime greater than 3");
+    }
+
+    if (!params.curve.empty()) {
+        validate_curve_params(params);
+        return;
+    }
+
+    if (params.g != 0 && (params.g <= 1 || params.g >= params.p)) {
+        throw std::invalid_argument("g must be in [2, p - 1]");
+    }
+
+    if (params.order < 0) {
+        throw std::invalid_argument("order must not be negative");
+    }
+
+    if (params.g != 0 && params.order != 0) {
+        mpz_class check;
+        mpz_powm(check.get_mpz_t(), params.g.get_mpz_t(), params.order.get_mpz_t(), params.p.get_mpz_t());
+        if (check != 1) {
+            throw std::invalid_argument("g^order is not 1 mod p");
+        }
+    }
+}
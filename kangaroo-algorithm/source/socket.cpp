@@ -0,0 +1,129 @@
+#include <string>
+#include <stdexcept>
+#include <cstring>
+#include <cerrno>
+#include <netdb.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "../headers/socket.h"
+
+namespace {
+    const std::string UNIX_PREFIX = "unix:";
+
+    bool is_unix(const std::string& address) { return address.compare(0, UNIX_PREFIX.size(), UNIX_PREFIX) == 0; }
+
+    sockaddr_un unix_address(const std::string& address) {
+        const std::string path = address.substr(UNIX_PREFIX.size());
+        sockaddr_un result = {};
+        result.sun_family = AF_UNIX;
+        if (path.empty() || path.size() >= sizeof(result.sun_path)) {
+            throw std::runtime_error("invalid Unix socket path in " + address);
+        }
+        std::memcpy(result.sun_path, path.c_str(), path.size() + 1);
+        return result;
+    }
+
+    // Resolves host:port, the host may be empty for a listening socket
+    addrinfo* tcp_addresses(const std::string& address, bool passive) {
+        const size_t colon = address.rfind(':');
+        if (colon == std::string::npos) throw std::runtime_error("address " + address + " has no port");
+
+        const std::string host = address.substr(0, colon);
+        const std::string port = address.substr(colon + 1);
+        addrinfo hints = {};
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+        hints.ai_flags = passive ? AI_PASSIVE : 0;
+        addrinfo* result = nullptr;
+        const int error = getaddrinfo(host.empty() ? nullptr : host.c_str(), port.c_str(), &hints, &result);
+        if (error) throw std::runtime_error("cannot resolve " + address + ": " + gai_strerror(error));
+        return result;
+    }
+}
+
+int listen_on(const std::string& address) {
+    if (is_unix(address)) {
+        const sockaddr_un local = unix_address(address);
+        unlink(local.sun_path);
+        const int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd < 0 || bind(fd, reinterpret_cast<const sockaddr*>(&local), sizeof(local)) != 0 || listen(fd, 64) != 0) {
+            if (fd >= 0) close(fd);
+            throw std::runtime_error("cannot listen on " + address + ": " + std::strerror(errno));
+        }
+        return fd;
+    }
+
+    addrinfo* addresses = tcp_addresses(address, true);
+    for (addrinfo* a = addresses; a; a = a->ai_next) {
+        const int fd = socket(a->ai_family, a->ai_socktype, a->ai_protocol);
+        if (fd < 0) continue;
+
+        const int reuse = 1;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+        if (bind(fd, a->ai_addr, a->ai_addrlen) == 0 && listen(fd, 64) == 0) {
+            freeaddrinfo(addresses);
+            return fd;
+        }
+        close(fd);
+    }
+    freeaddrinfo(addresses);
+    throw std::runtime_error("cannot listen on " + address + ": " + std::strerror(errno));
+}
+
+void close_listener(int fd, const std::string& address) {
+    close(fd);
+    if (is_unix(address)) unlink(unix_address(address).sun_path);
+}
+
+int connect_to(const std::string& address) {
+    if (is_unix(address)) {
+        const sockaddr_un remote = unix_address(address);
+        const int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd < 0 || connect(fd, reinterpret_cast<const sockaddr*>(&remote), sizeof(remote)) != 0) {
+            if (fd >= 0) close(fd);
+            throw std::runtime_error("cannot connect to " + address + ": " + std::strerror(errno));
+        }
+        return fd;
+    }
+
+    addrinfo* addresses = tcp_addresses(address, false);
+    for (addrinfo* a = addresses; a; a = a->ai_next) {
+        const int fd = socket(a->ai_family, a->ai_socktype, a->ai_protocol);
+        if (fd < 0) continue;
+
+        if (connect(fd, a->ai_addr, a->ai_addrlen) == 0) {
+            freeaddrinfo(addresses);
+            return fd;
+        }
+        close(fd);
+    }
+    freeaddrinfo(addresses);
+    throw std::runtime_error("cannot connect to " + address + ": " + std::strerror(errno));
+}
+
+bool send_all(int fd, const void* data, size_t size) {
+    const char* p = static_cast<const char*>(data);
+    while (size) {
+        // A closed peer must not raise SIGPIPE
+        const ssize_t sent = send(fd, p, size, MSG_NOSIGNAL);
+        if (sent < 0 && errno == EINTR) continue;
+        if (sent <= 0) return false;
+        p += sent;
+        size -= sent;
+    }
+    return true;
+}
+
+bool receive_all(int fd, void* data, size_t size) {
+    char* p = static_cast<char*>(data);
+    while (size) {
+        const ssize_t received = recv(fd, p, size, 0);
+        if (received < 0 && errno == EINTR) continue;
+        if (received <= 0) return false;
+        p += received;
+        size -= received;
+    }
+    return true;
+}
@@ -3,99 +3,1153 @@
 #include <gmpxx.h>
 #include <fstream>
 #include <string>
-#include <getopt.h>
 #include <vector>
-#include <sstream>
+#include <cstdlib>
+#include <cstdio>
+#include <cerrno>
+#include <new>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <stdexcept>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <random>
+#include <map>
+#include <queue>
 
 #include "../headers/table.h"
 
-std::vector<uint8_t> hexStringToBytes(const std::string& hex) {
-    std::vector<uint8_t> bytes;
-    for (size_t i = 0; i < hex.length(); i += 2) {
-        std::string byteString = hex.substr(i, 2);
-        uint8_t byte = static_cast<uint8_t>(strtol(byteString.c_str(), nullptr, 16));
-        bytes.push_back(byte);
+uint64_t point_fingerprint(const mpz_class& x) {
+    uint64_t h = 0x9e3779b97f4a7c15ULL;
+    const size_t limbs = mpz_size(x.get_mpz_t());
+    for (size_t i = 0; i < limbs; ++i) {
+        h = (h ^ (uint64_t) mpz_getlimbn(x.get_mpz_t(), i)) * 0xff51afd7ed558ccdULL;
+        h ^= h >> 32;
+    }
+
+    // Finalizer of MurmurHash3
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h ? h : 1;
+}
+
+namespace {
+    // Slots for n entries: a power of two, at least 16, that keeps the table at most half full
+    size_t table_capacity(size_t n) {
+        size_t capacity = 16;
+        while (capacity < 2 * n) capacity <<= 1;
+        return capacity;
+    }
+}
+
+void DistinguishedTable::reserve(size_t n) {
+    const size_t capacity = table_capacity(n);
+    if (capacity <= slots.size()) return;
+
+    std::vector<TableEntry> old(capacity, TableEntry{0, 0, 0});
+    old.swap(slots);
+    std::vector<uint32_t> old_hits(hits.empty() ? 0 : capacity, 0);
+    old_hits.swap(hits);
+    for (size_t j = 0; j < old.size(); ++j) {
+        if (!old[j].key) continue;
+
+        const size_t i = probe(old[j].key);
+        slots[i] = old[j];
+        if (!hits.empty()) hits[i] = old_hits[j];
+    }
+}
+
+size_t DistinguishedTable::probe(uint64_t key) const {
+    const size_t mask = slots.size() - 1;
+    size_t i = key & mask;
+    while (slots[i].key && slots[i].key != key) i = (i + 1) & mask;
+    return i;
+}
+
+bool DistinguishedTable::insert(uint64_t key, int128_t log) {
+    if (2 * (count + 1) > slots.size()) reserve(count + 1);
+
+    const size_t i = probe(key);
+    if (!hits.empty()) ++hits[i];
+    if (slots[i].key) return false;
+
+    slots[i] = TableEntry{key, (uint64_t) log, (uint64_t) ((uint128_t) log >> 64)};
+    ++count;
+    return true;
+}
+
+bool DistinguishedTable::insert_concurrent(uint64_t key, int128_t log, size_t limit) {
+    const size_t mask = slots.size() - 1;
+    size_t i = key & mask;
+
+    // Skip the occupied slots of the probe sequence first, the key may already be there
+    for (uint64_t k; (k = __atomic_load_n(&slots[i].key, __ATOMIC_ACQUIRE)); i = (i + 1) & mask) {
+        if (k == key) {
+            if (!hits.empty()) __atomic_fetch_add(&hits[i], 1, __ATOMIC_RELAXED);
+            return false;
+        }
+    }
+
+    size_t n = count.load();
+    do {
+        if (n >= limit) return false;
+    } while (!count.compare_exchange_weak(n, n + 1));
+
+    for (;; i = (i + 1) & mask) {
+        uint64_t expected = 0;
+        if (__atomic_compare_exchange_n(&slots[i].key, &expected, key, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+            slots[i].log_lo = (uint64_t) log;
+            slots[i].log_hi = (uint64_t) ((uint128_t) log >> 64);
+            if (!hits.empty()) __atomic_fetch_add(&hits[i], 1, __ATOMIC_RELAXED);
+            return true;
+        }
+        // Another thread inserted the same key meanwhile, give the count back
+        if (expected == key) {
+            --count;
+            if (!hits.empty()) __atomic_fetch_add(&hits[i], 1, __ATOMIC_RELAXED);
+            return false;
+        }
+    }
+}
+
+bool DistinguishedTable::find(uint64_t key, int128_t& log) const {
+    if (slots.empty()) return false;
+
+    const size_t mask = slots.size() - 1;
+    for (size_t i = key & mask; slots[i].key; i = (i + 1) & mask) {
+        if (slots[i].key == key) {
+            log = slots[i].log();
+            return true;
+        }
+    }
+    return false;
+}
+
+void DistinguishedTable::keep_most_hit(size_t n) {
+    if (count <= n) return;
+
+    std::vector<size_t> occupied;
+    occupied.reserve(count);
+    for (size_t i = 0; i < slots.size(); ++i) {
+        if (slots[i].key) occupied.push_back(i);
+    }
+    std::nth_element(occupied.begin(), occupied.begin() + n, occupied.end(), [&](size_t a, size_t b) {
+        return hits[a] > hits[b];
+    });
+
+    std::vector<TableEntry> old_slots;
+    std::vector<uint32_t> old_hits;
+    old_slots.swap(slots);
+    old_hits.swap(hits);
+    count = 0;
+    reserve(n);
+    count_hits();
+    for (size_t j = 0; j < n; ++j) {
+        const TableEntry& entry = old_slots[occupied[j]];
+        const size_t i = probe(entry.key);
+        slots[i] = entry;
+        hits[i] = old_hits[occupied[j]];
+        ++count;
+    }
+}
+
+void DistinguishedTable::clear() {
+    std::vector<TableEntry>().swap(slots);
+    std::vector<uint32_t>().swap(hits);
+    count = 0;
+}
+
+namespace {
+    const char TABLE_MAGIC[8] = {'K', 'A', 'N', 'G', 'T', 'A', 'B', 'L'};
+    const uint32_t TABLE_VERSION = 3;
+    const char PACKED_MAGIC[8] = {'K', 'A', 'N', 'G', 'P', 'A', 'C', 'K'};
+    const uint32_t PACKED_VERSION = 2;
+    const char CHECKPOINT_MAGIC[8] = {'K', 'A', 'N', 'G', 'C', 'K', 'P', 'T'};
+    const uint32_t CHECKPOINT_VERSION = 2;
+    // Entries per decoding chunk of a packed file, whose starting position in the upper bits is stored
+    const int PACKED_CHUNK_BITS = 12;
+
+    uint64_t align64(uint64_t x) { return (x + 63) & ~(uint64_t) 63; }
+
+    uint64_t low_mask(int bits) { return bits >= 64 ? ~(uint64_t) 0 : ((uint64_t) 1 << bits) - 1; }
+
+    int bit_length(uint128_t x) {
+        int bits = 0;
+        for (; x; x >>= 1) ++bits;
+        return bits;
+    }
+
+    // Bit fields of at most 64 bits in a little-endian bit stream
+    void put_bits(std::vector<uint64_t>& words, size_t pos, uint64_t value, int width) {
+        if (!width) return;
+        value &= low_mask(width);
+        const size_t word = pos / 64;
+        const int shift = pos % 64;
+        words[word] |= value << shift;
+        if (shift + width > 64) words[word + 1] |= value >> (64 - shift);
+    }
+
+    uint64_t get_bits(const std::vector<uint64_t>& words, size_t pos, int width) {
+        if (!width) return 0;
+        const size_t word = pos / 64;
+        const int shift = pos % 64;
+        uint64_t value = words[word] >> shift;
+        if (shift + width > 64) value |= words[word + 1] << (64 - shift);
+        return value & low_mask(width);
+    }
+
+    // Bit fields of at most 64 bits appended to a little-endian bit stream in a file
+    struct BitStream {
+        BlockWriter& out;
+        uint64_t word = 0;
+        int filled = 0;
+        uint64_t words = 0;
+
+        explicit BitStream(BlockWriter& out) : out(out) {}
+
+        void put(uint64_t value, int width) {
+            if (!width) return;
+            value &= low_mask(width);
+            word |= value << filled;
+            if (filled + width < 64) {
+                filled += width;
+                return;
+            }
+            out.write(&word, sizeof(word));
+            ++words;
+            word = filled ? value >> (64 - filled) : 0;
+            filled += width - 64;
+        }
+
+        // Writes the last partial word and pads the stream with zero words to total
+        void finish(uint64_t total) {
+            if (filled) put(0, 64 - filled);
+            for (word = 0; words < total; ++words) out.write(&word, sizeof(word));
+        }
+    };
+
+    // At most one bucket per key; fingerprints are uniform, so the top bits spread them evenly
+    int frozen_bucket_bits(size_t count) {
+        int bits = 0;
+        while (bits < 63 && (2ULL << bits) <= count) ++bits;
+        return bits;
+    }
+
+    // Header of a table file of n entries
+    TableFileHeader table_file_header(size_t n, size_t params_bytes) {
+        const int bits = frozen_bucket_bits(n);
+
+        TableFileHeader header = {};
+        std::copy(TABLE_MAGIC, TABLE_MAGIC + 8, header.magic);
+        header.version = TABLE_VERSION;
+        header.bucket_bits = bits;
+        header.count = n;
+        header.keys_offset = sizeof(TableFileHeader);
+        header.logs_offset = align64(header.keys_offset + n * sizeof(uint64_t));
+        header.offsets_offset = align64(header.logs_offset + n * sizeof(int128_t));
+        header.params_offset = align64(header.offsets_offset + ((1ULL << bits) + 1) * sizeof(uint64_t));
+        header.size = header.params_offset + params_bytes;
+        return header;
+    }
+
+    // Offsets of the first key of every bucket and the key count, from the sorted keys
+    void fill_bucket_offsets(const uint64_t* keys, size_t count, int bucket_bits, uint64_t* offsets) {
+        std::fill(offsets, offsets + (1ULL << bucket_bits) + 1, 0);
+        for (size_t i = 0; i < count; ++i) ++offsets[(bucket_bits ? keys[i] >> (64 - bucket_bits) : 0) + 1];
+        for (size_t b = 1; b <= (1ULL << bucket_bits); ++b) offsets[b] += offsets[b - 1];
+    }
+
+    // Little-endian fields of the serialized parameters; strings are prefixed by their length
+    void put_field(std::string& out, uint64_t value) {
+        for (int j = 0; j < 8; ++j) out.push_back((char) (value >> (8 * j)));
+    }
+
+    void put_field(std::string& out, const std::string& value) {
+        put_field(out, value.size());
+        out += value;
+    }
+}
+
+std::string TableParams::serialize() const {
+    std::string out;
+    put_field(out, R);
+    put_field(out, W);
+    put_field(out, secret_size);
+    put_field(out, negation_map);
+    for (const std::string* value : {&p, &g, &order, &curve, &backend}) put_field(out, *value);
+    put_field(out, slog.size());
+    for (uint128_t x : slog) {
+        put_field(out, (uint64_t) x);
+        put_field(out, (uint64_t) (x >> 64));
+    }
+    return out;
+}
+
+bool TableParams::parse(const char* data, size_t size) {
+    size_t pos = 0;
+    auto get = [&](uint64_t& value) {
+        if (size - pos < 8) return false;
+        value = 0;
+        for (int j = 0; j < 8; ++j) value |= (uint64_t) (uint8_t) data[pos + j] << (8 * j);
+        pos += 8;
+        return true;
+    };
+    auto get_string = [&](std::string& value) {
+        uint64_t length;
+        if (!get(length) || size - pos < length) return false;
+        value.assign(data + pos, length);
+        pos += length;
+        return true;
+    };
+
+    uint64_t r, w, bits, negation, jumps;
+    if (!get(r) || !get(w) || !get(bits) || !get(negation)) return false;
+    for (std::string* value : {&p, &g, &order, &curve, &backend}) {
+        if (!get_string(*value)) return false;
+    }
+    if (!get(jumps) || jumps != r || (size - pos) / 16 < jumps) return false;
+
+    R = (long) r;
+    W = (long) w;
+    secret_size = (int) bits;
+    negation_map = negation != 0;
+    slog.resize(jumps);
+    for (uint128_t& x : slog) {
+        uint64_t lo = 0, hi = 0;
+        get(lo);
+        get(hi);
+        x = ((uint128_t) hi << 64) | lo;
+    }
+    return true;
+}
+
+BlockWriter::BlockWriter(const std::string& path) {
+    fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    for (char*& block : blocks) {
+        block = static_cast<char*>(std::aligned_alloc(4096, BLOCK_SIZE));
+        if (!block) throw std::bad_alloc();
+    }
+    current = blocks[0];
+}
+
+BlockWriter::~BlockWriter() {
+    if (fd >= 0) close();
+    for (char* block : blocks) std::free(block);
+}
+
+void BlockWriter::write_blocks(const void* data, size_t size) {
+    const char* p = static_cast<const char*>(data);
+    while (size) {
+        const size_t n = std::min(size, BLOCK_SIZE - used);
+        std::memcpy(current + used, p, n);
+        used += n;
+        p += n;
+        size -= n;
+        if (used == BLOCK_SIZE) submit();
+    }
+}
+
+void BlockWriter::submit() {
+    if (pending.valid()) failed |= !pending.get();
+
+    pending = std::async(std::launch::async, [fd = fd, block = current, size = used]() {
+        for (size_t done = 0; done < size;) {
+            const ssize_t n = ::write(fd, block + done, size - done);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) return false;
+            done += n;
+        }
+        return true;
+    });
+    current = current == blocks[0] ? blocks[1] : blocks[0];
+    used = 0;
+}
+
+bool BlockWriter::close(bool sync) {
+    if (fd < 0) return false;
+
+    if (used) submit();
+    if (pending.valid()) failed |= !pending.get();
+    if (sync && fsync(fd) != 0) failed = true;
+    if (::close(fd) != 0) failed = true;
+    fd = -1;
+    return !failed;
+}
+
+bool DistinguishedTable::writeCheckpoint(std::string path, const GenerationCheckpoint& state, bool sorted) const {
+    const std::string temporary = path + ".tmp";
+    BlockWriter outFile(temporary);
+    if (!outFile.is_open()) {
+        std::cerr << "Error: Unable to open file for writing: " << temporary << std::endl;
+        return false;
+    }
+
+    const std::string serialized = state.params.serialize();
+    CheckpointFileHeader header = {};
+    std::copy(CHECKPOINT_MAGIC, CHECKPOINT_MAGIC + 8, header.magic);
+    header.version = CHECKPOINT_VERSION;
+    header.sorted = sorted;
+    header.count = count;
+    header.slots = table_capacity(count);
+    header.numsteps = state.numsteps;
+    header.runs = state.runs;
+    header.spilled_runs = state.spilled_runs;
+    header.spilled_entries = state.spilled_entries;
+    header.params_bytes = serialized.size();
+    outFile.write(&header, sizeof(header));
+
+    std::vector<size_t> occupied;
+    occupied.reserve(count);
+    for (size_t i = 0; i < slots.size(); ++i) {
+        if (slots[i].key) occupied.push_back(i);
+    }
+    if (sorted) std::sort(occupied.begin(), occupied.end(), [&](size_t a, size_t b) {
+        return slots[a].key < slots[b].key;
+    });
+    for (size_t i : occupied) {
+        const CheckpointRecord record = {slots[i].key, slots[i].log_lo, slots[i].log_hi,
+                                         hits.empty() ? 0 : hits[i], 0};
+        outFile.write(&record, sizeof(record));
+    }
+    outFile.write(serialized.data(), serialized.size());
+
+    // The data has to be on disk before the rename replaces the previous checkpoint
+    return outFile.close(true) && std::rename(temporary.c_str(), path.c_str()) == 0;
+}
+
+bool DistinguishedTable::readCheckpoint(std::string path, GenerationCheckpoint& state) {
+    std::ifstream inFile(path, std::ios::binary);
+    if (!inFile) {
+        std::cerr << "Error: Unable to open file for reading: " << path << std::endl;
+        return false;
+    }
+
+    CheckpointFileHeader header = {};
+    inFile.read(reinterpret_cast<char*>(&header), sizeof(header));
+
+    // The records and the parameters have to fill the file exactly, and the slots must not exceed what they need
+    struct stat st;
+    const uint64_t size = stat(path.c_str(), &st) == 0 ? st.st_size : 0;
+    const bool sized = header.count <= size / sizeof(CheckpointRecord) && header.params_bytes <= size &&
+                       sizeof(header) + header.count * sizeof(CheckpointRecord) + header.params_bytes == size;
+    if (!inFile || !std::equal(CHECKPOINT_MAGIC, CHECKPOINT_MAGIC + 8, header.magic) ||
+        header.version != CHECKPOINT_VERSION || !sized || 2 * header.count > header.slots ||
+        header.slots > table_capacity(header.count) || (header.slots & (header.slots - 1))) {
+        std::cerr << "Error: Not a version " << CHECKPOINT_VERSION << " checkpoint file: " << path << std::endl;
+        return false;
+    }
+
+    clear();
+    slots.assign(table_capacity(header.count), TableEntry{0, 0, 0});
+    count_hits();
+    for (uint64_t j = 0; j < header.count && inFile; ++j) {
+        CheckpointRecord record;
+        inFile.read(reinterpret_cast<char*>(&record), sizeof(record));
+        if (!inFile || !record.key) break;
+
+        const size_t i = probe(record.key);
+        slots[i] = TableEntry{record.key, record.log_lo, record.log_hi};
+        hits[i] = record.hits;
+        ++count;
+    }
+
+    std::string serialized(header.params_bytes, '\0');
+    inFile.read(&serialized[0], serialized.size());
+    if (!inFile || count != header.count || !state.params.parse(serialized.data(), serialized.size())) {
+        std::cerr << "Error: Truncated checkpoint file: " << path << std::endl;
+        clear();
+        return false;
+    }
+    state.numsteps = header.numsteps;
+    state.runs = header.runs;
+    state.spilled_runs = header.spilled_runs;
+    state.spilled_entries = header.spilled_entries;
+    return true;
+}
+
+FrozenTable::FrozenTable(const DistinguishedTable& table, const TableParams& params) {
+    std::vector<TableEntry> entries;
+    entries.reserve(table.size());
+    for (const TableEntry& entry : table.slots) {
+        if (entry.key) entries.push_back(entry);
+    }
+    std::sort(entries.begin(), entries.end(), [](const TableEntry& a, const TableEntry& b) { return a.key < b.key; });
+
+    uint64_t* k;
+    int128_t* l;
+    allocate(entries.size(), params, k, l);
+    for (size_t i = 0; i < entries.size(); ++i) {
+        k[i] = entries[i].key;
+        l[i] = entries[i].log();
+    }
+    build_index();
+}
+
+void FrozenTable::allocate(size_t n, const TableParams& table_params, uint64_t*& keys_out, int128_t*& logs_out) {
+    const std::string serialized = table_params.serialize();
+    const TableFileHeader header = table_file_header(n, serialized.size());
+
+    std::shared_ptr<void> data(std::aligned_alloc(64, align64(header.size)), std::free);
+    if (!data) throw std::bad_alloc();
+    char* base = static_cast<char*>(data.get());
+    std::fill(base, base + header.size, 0);
+    *reinterpret_cast<TableFileHeader*>(base) = header;
+    std::copy(serialized.begin(), serialized.end(), base + header.params_offset);
+
+    keys_out = reinterpret_cast<uint64_t*>(base + header.keys_offset);
+    logs_out = reinterpret_cast<int128_t*>(base + header.logs_offset);
+    attach(data, header.size);
+}
+
+void FrozenTable::build_index() {
+    // The image was allocated here, so it may be written
+    fill_bucket_offsets(keys, count, bucket_bits, const_cast<uint64_t*>(offsets));
+}
+
+bool FrozenTable::attach(std::shared_ptr<const void> data, size_t size) {
+    const char* base = static_cast<const char*>(data.get());
+    const TableFileHeader& header = *reinterpret_cast<const TableFileHeader*>(base);
+    if (!params.parse(base + header.params_offset, size - header.params_offset)) return false;
+
+    image = std::move(data);
+    image_size = size;
+    keys = reinterpret_cast<const uint64_t*>(base + header.keys_offset);
+    logs = reinterpret_cast<const int128_t*>(base + header.logs_offset);
+    offsets = reinterpret_cast<const uint64_t*>(base + header.offsets_offset);
+    count = header.count;
+    bucket_bits = (int) header.bucket_bits;
+    return true;
+}
+
+bool FrozenTable::find(uint64_t key, int128_t& log) const {
+    if (!count) return false;
+
+    const size_t bucket = bucket_bits ? key >> (64 - bucket_bits) : 0;
+    for (size_t i = offsets[bucket]; i < offsets[bucket + 1]; ++i) {
+        if (keys[i] >= key) {
+            if (keys[i] != key) return false;
+            log = logs[i];
+            return true;
+        }
+    }
+    return false;
+}
+
+CompressedTable::CompressedTable(const FrozenTable& table, int key_bits, int log_bits)
+        : key_bits(key_bits), log_bits(log_bits), count(table.size()) {
+    if (key_bits < 1 || key_bits > 64 || log_bits < 1 || log_bits > 128) {
+        throw std::invalid_argument("compressed tables keep 1 to 64 key bits and 1 to 128 log bits");
+    }
+
+    while (bucket_bits < key_bits && (16ULL << bucket_bits) <= count) ++bucket_bits;
+
+    const int entry_bits = rest_bits() + log_bits;
+    offsets.assign((1ULL << bucket_bits) + 1, 0);
+    entries.assign((count * entry_bits + 63) / 64 + 1, 0);
+
+    // Truncating the sorted fingerprints to their top bits keeps them sorted
+    size_t pos = 0;
+    for (size_t i = 0; i < count; ++i) {
+        const uint64_t key = table.keys[i] >> (64 - key_bits);
+        ++offsets[(bucket_bits ? key >> rest_bits() : 0) + 1];
+
+        const uint128_t log = (uint128_t) table.logs[i];
+        put_bits(entries, pos, key, rest_bits());
+        put_bits(entries, pos + rest_bits(), (uint64_t) log, std::min(log_bits, 64));
+        put_bits(entries, pos + rest_bits() + 64, (uint64_t) (log >> 64), std::max(log_bits - 64, 0));
+        pos += entry_bits;
+    }
+    for (size_t b = 1; b < offsets.size(); ++b) offsets[b] += offsets[b - 1];
+}
+
+size_t CompressedTable::find(uint64_t key, std::vector<uint128_t>& logs) const {
+    if (!count) return 0;
+
+    const int entry_bits = rest_bits() + log_bits;
+    const uint64_t truncated = key >> (64 - key_bits);
+    const size_t bucket = bucket_bits ? truncated >> rest_bits() : 0;
+    const uint64_t rest = truncated & low_mask(rest_bits());
+
+    size_t found = 0;
+    for (size_t i = offsets[bucket]; i < offsets[bucket + 1]; ++i) {
+        const size_t pos = i * entry_bits;
+        const uint64_t entry_rest = get_bits(entries, pos, rest_bits());
+        if (entry_rest > rest) break;
+        if (entry_rest < rest) continue;
+
+        uint128_t log = get_bits(entries, pos + rest_bits(), std::min(log_bits, 64));
+        log |= (uint128_t) get_bits(entries, pos + rest_bits() + 64, std::max(log_bits - 64, 0)) << 64;
+        logs.push_back(log);
+        ++found;
+    }
+    return found;
+}
+
+PerfectHashTable::PerfectHashTable(const FrozenTable& table) : count(table.size()) {
+    if (!count) return;
+
+    pilots.assign((count + 3) / 4, 0);
+    records.assign(count * 50 / 49 + 1, PerfectHashRecord{0, 0, 0});
+
+    // A bucket that finds no pilot among 2^16 is very unlikely, another seed starts over
+    for (seed = 0; !build(table); ++seed) {
+        if (seed == 16) throw std::runtime_error("no perfect hash found for the table");
+    }
+}
+
+bool PerfectHashTable::build(const FrozenTable& table) {
+    const size_t buckets = pilots.size();
+
+    // Keys are sorted, so each bucket is a run of them
+    std::vector<size_t> first(buckets + 1, 0);
+    for (size_t i = 0; i < count; ++i) ++first[bucket(table.keys[i]) + 1];
+    for (size_t b = 1; b <= buckets; ++b) first[b] += first[b - 1];
+
+    // Larger buckets are placed first, while there are many free slots
+    std::vector<size_t> order(buckets);
+    for (size_t b = 0; b < buckets; ++b) order[b] = b;
+    std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+        return first[a + 1] - first[a] > first[b + 1] - first[b];
+    });
+
+    std::vector<bool> taken(records.size(), false);
+    std::vector<size_t> slots;
+    for (size_t b : order) {
+        const size_t size = first[b + 1] - first[b];
+        if (!size) break;
+
+        bool placed = false;
+        for (uint32_t pilot = 0; pilot <= 0xffff && !placed; ++pilot) {
+            slots.clear();
+            for (size_t i = first[b]; i < first[b + 1]; ++i) {
+                const size_t s = slot(table.keys[i], pilot);
+                if (taken[s] || std::find(slots.begin(), slots.end(), s) != slots.end()) break;
+                slots.push_back(s);
+            }
+            if (slots.size() != size) continue;
+
+            pilots[b] = pilot;
+            for (size_t j = 0; j < size; ++j) {
+                taken[slots[j]] = true;
+                records[slots[j]] = PerfectHashRecord{table.keys[first[b] + j], 0, table.logs[first[b] + j]};
+            }
+            placed = true;
+        }
+        if (!placed) {
+            std::fill(records.begin(), records.end(), PerfectHashRecord{0, 0, 0});
+            return false;
+        }
+    }
+    return true;
+}
+
+TableFilter::TableFilter(const uint64_t* keys, size_t count, int bits_per_key) {
+    if (bits_per_key < 1) throw std::invalid_argument("the table filter needs at least 1 bit per key");
+
+    blocks.assign(std::max<size_t>((count * bits_per_key + 255) / 256, 1), Block{});
+    for (size_t i = 0; i < count; ++i) {
+        Block& block = blocks[block_of(keys[i])];
+        for (int j = 0; j < 8; ++j) block.words[j] |= bit_of(keys[i], j);
     }
-    return bytes;
 }
 
-// Helper function to convert a byte array to a hex string
-std::string bytesToHexString(const std::vector<uint8_t>& bytes) {
-    std::ostringstream oss;
-    for (uint8_t byte : bytes) {
-        oss << std::hex << std::setw(2) << std::setfill('0') << static_cast<int>(byte);
+TableBenchmark benchmark_table_lookups(const FrozenTable& table, size_t lookups, int filter_bits) {
+    typedef std::chrono::high_resolution_clock Clock;
+    TableBenchmark result = {};
+
+    auto build_start = Clock::now();
+    PerfectHashTable perfect(table);
+    result.perfect_build_millis = std::chrono::duration<double, std::milli>(Clock::now() - build_start).count();
+    result.perfect_bytes = perfect.memory_bytes();
+
+    std::mt19937_64 random(1);
+    std::vector<uint64_t> hits(lookups), misses(lookups);
+    for (size_t i = 0; i < lookups; ++i) {
+        hits[i] = table.size() ? table.keys[random() % table.size()] : 1;
+        misses[i] = random() | 1;
+    }
+
+    // The found logs are summed so that no lookup can be left out
+    int128_t sum = 0;
+    auto time = [&](const std::vector<uint64_t>& keys, auto find) {
+        auto start = Clock::now();
+        for (uint64_t key : keys) {
+            int128_t log = 0;
+            if (find(key, log)) sum += log;
+        }
+        return std::chrono::duration<double, std::nano>(Clock::now() - start).count() / std::max<size_t>(lookups, 1);
+    };
+    auto frozen_find = [&](uint64_t key, int128_t& log) { return table.find(key, log); };
+    auto perfect_find = [&](uint64_t key, int128_t& log) { return perfect.find(key, log); };
+
+    result.frozen_hit = time(hits, frozen_find);
+    result.frozen_miss = time(misses, frozen_find);
+    result.perfect_hit = time(hits, perfect_find);
+    result.perfect_miss = time(misses, perfect_find);
+    if (filter_bits) {
+        TableFilter filter(table.keys, table.size(), filter_bits);
+        result.filtered_miss = time(misses, [&](uint64_t key, int128_t& log) {
+            return filter.may_contain(key) && table.find(key, log);
+        });
     }
-    return oss.str();
+    volatile uint64_t sink = (uint64_t) sum;
+    (void) sink;
+    return result;
 }
 
 // Function to write data to a file
-bool TableDataMap::writeToFile(std::string path) {
-    std::ofstream outFile(path, std::ios::binary);
-    if (!outFile) {
+bool FrozenTable::writeToFile(std::string path) const {
+    BlockWriter outFile(path);
+    if (!outFile.is_open()) {
         std::cerr << "Error: Unable to open file for writing: " << path << std::endl;
         return false;
     }
 
-    // Write the size of the map
-    size_t mapSize = tableMap.size();
-    outFile.write(reinterpret_cast<const char*>(&mapSize), sizeof(mapSize));
+    if (image) outFile.write(image.get(), image_size);
+
+    return outFile.close();
+}
+
+bool FrozenTable::writePacked(std::string path) const {
+    BlockWriter outFile(path);
+    if (!outFile.is_open()) {
+        std::cerr << "Error: Unable to open file for writing: " << path << std::endl;
+        return false;
+    }
+
+    int128_t log_min = 0, log_max = 0;
+    for (size_t i = 0; i < count; ++i) {
+        if (!i || logs[i] < log_min) log_min = logs[i];
+        if (!i || logs[i] > log_max) log_max = logs[i];
+    }
+
+    // About 2 high bits per key when the low bits take log2(2^64 / count)
+    PackedTableHeader header = {};
+    std::copy(PACKED_MAGIC, PACKED_MAGIC + 8, header.magic);
+    header.version = PACKED_VERSION;
+    header.low_bits = std::min(64 - bit_length(count > 1 ? count - 1 : 0), 63);
+    header.count = count;
+    header.log_bits = bit_length((uint128_t) log_max - (uint128_t) log_min);
+    header.chunk_bits = PACKED_CHUNK_BITS;
+    header.log_min_lo = (uint64_t) log_min;
+    header.log_min_hi = (uint64_t) ((uint128_t) log_min >> 64);
+    header.chunk_words = (count + (1ULL << PACKED_CHUNK_BITS) - 1) >> PACKED_CHUNK_BITS;
+    header.low_words = (count * header.low_bits + 63) / 64 + 1;
+    header.high_words = (count + (count ? keys[count - 1] >> header.low_bits : 0) + 64) / 64 + 1;
+    header.log_words = (count * header.log_bits + 63) / 64 + 1;
+    const std::string serialized = params.serialize();
+    header.params_bytes = serialized.size();
+
+    // The sections are encoded one after the other straight into the writer
+    outFile.write(&header, sizeof(header));
+    for (size_t i = 0; i < count; i += 1ULL << PACKED_CHUNK_BITS) {
+        const uint64_t bit = (keys[i] >> header.low_bits) + i;
+        outFile.write(&bit, sizeof(bit));
+    }
+
+    BitStream low(outFile);
+    for (size_t i = 0; i < count; ++i) low.put(keys[i], header.low_bits);
+    low.finish(header.low_words);
+
+    // Bits of the high parts in increasing positions, as the keys are sorted
+    uint64_t word = 0, words = 0;
+    for (size_t i = 0; i < count; ++i) {
+        const uint64_t bit = (keys[i] >> header.low_bits) + i;
+        for (; bit / 64 > words; ++words, word = 0) outFile.write(&word, sizeof(word));
+        word |= (uint64_t) 1 << (bit % 64);
+    }
+    for (; words < header.high_words; ++words, word = 0) outFile.write(&word, sizeof(word));
+
+    BitStream packed_logs(outFile);
+    for (size_t i = 0; i < count; ++i) {
+        const uint128_t log = (uint128_t) logs[i] - (uint128_t) log_min;
+        packed_logs.put((uint64_t) log, std::min<int>(header.log_bits, 64));
+        packed_logs.put((uint64_t) (log >> 64), std::max<int>(header.log_bits - 64, 0));
+    }
+    packed_logs.finish(header.log_words);
+    outFile.write(serialized.data(), serialized.size());
+
+    return outFile.close();
+}
+
+bool FrozenTable::readPacked(const std::string path) {
+    std::ifstream inFile(path, std::ios::binary);
+    PackedTableHeader header = {};
+    inFile.read(reinterpret_cast<char*>(&header), sizeof(header));
+
+    const uint64_t n = header.count;
+    bool valid = inFile && std::equal(PACKED_MAGIC, PACKED_MAGIC + 8, header.magic) &&
+                 header.version == PACKED_VERSION && header.low_bits < 64 && header.log_bits <= 128 &&
+                 header.chunk_bits == PACKED_CHUNK_BITS &&
+                 header.chunk_words == (n + (1ULL << PACKED_CHUNK_BITS) - 1) >> PACKED_CHUNK_BITS &&
+                 header.low_words == (n * header.low_bits + 63) / 64 + 1 &&
+                 header.log_words == (n * header.log_bits + 63) / 64 + 1 && header.high_words >= n / 64 + 1;
+
+    // The sections have to fill the file exactly before anything is allocated for them
+    struct stat st;
+    const uint64_t size = stat(path.c_str(), &st) == 0 ? st.st_size : 0;
+    const uint64_t max_words = size / sizeof(uint64_t);
+    valid = valid && header.chunk_words <= max_words && header.low_words <= max_words &&
+            header.high_words <= max_words && header.log_words <= max_words && header.params_bytes <= size &&
+            sizeof(header) + sizeof(uint64_t) * (header.chunk_words + header.low_words + header.high_words +
+                                                 header.log_words) + header.params_bytes == size;
+    if (!valid) {
+        std::cerr << "Error: Not a version " << PACKED_VERSION << " packed table file: " << path << std::endl;
+        return false;
+    }
+
+    std::vector<uint64_t> chunks(header.chunk_words), low(header.low_words), high(header.high_words);
+    std::vector<uint64_t> packed_logs(header.log_words);
+    for (std::vector<uint64_t>* words : {&chunks, &low, &high, &packed_logs}) {
+        inFile.read(reinterpret_cast<char*>(words->data()), words->size() * sizeof(uint64_t));
+    }
+    std::string serialized(header.params_bytes, '\0');
+    inFile.read(&serialized[0], serialized.size());
+    TableParams table_params;
+    if (!inFile || !table_params.parse(serialized.data(), serialized.size())) {
+        std::cerr << "Error: Truncated packed table file: " << path << std::endl;
+        return false;
+    }
+
+    uint64_t* k;
+    int128_t* l;
+    allocate(n, table_params, k, l);
+
+    // Chunks are handed out to the threads one at a time
+    const uint128_t log_min = ((uint128_t) header.log_min_hi << 64) | header.log_min_lo;
+    const uint64_t high_bits = header.high_words * 64;
+    std::atomic<size_t> next_chunk{0};
+    std::atomic<bool> corrupt{false};
+    auto decode = [&]() {
+        for (size_t c; (c = next_chunk++) < header.chunk_words && !corrupt;) {
+            const size_t first = c << PACKED_CHUNK_BITS;
+            const size_t last = std::min<size_t>(n, first + (1ULL << PACKED_CHUNK_BITS));
+            uint64_t bit = chunks[c];
+            for (size_t i = first; i < last; ++i, ++bit) {
+                // Next set bit of the high bits
+                uint64_t word = bit < high_bits ? high[bit / 64] >> (bit % 64) : 0;
+                while (!word && bit < high_bits) {
+                    bit = (bit / 64 + 1) * 64;
+                    word = bit < high_bits ? high[bit / 64] : 0;
+                }
+                if (!word) {
+                    corrupt = true;
+                    return;
+                }
+                bit += __builtin_ctzll(word);
+
+                k[i] = ((bit - i) << header.low_bits) | get_bits(low, i * header.low_bits, header.low_bits);
+                // A chunk has to start on its own first high bit, and its keys have to be sorted
+                if (i == first ? bit != chunks[c] : k[i] < k[i - 1]) {
+                    corrupt = true;
+                    return;
+                }
+                const size_t pos = i * header.log_bits;
+                uint128_t log = get_bits(packed_logs, pos, std::min<int>(header.log_bits, 64));
+                log |= (uint128_t) get_bits(packed_logs, pos + 64, std::max<int>(header.log_bits - 64, 0)) << 64;
+                l[i] = (int128_t) (log + log_min);
+            }
+        }
+    };
 
-    // Write each entry in the map
-    for (const auto& [key, entry] : tableMap) {
-        // Convert the hex string key to bytes
-        std::vector<uint8_t> keyBytes = hexStringToBytes(key);
-        size_t keySize = keyBytes.size();
-        outFile.write(reinterpret_cast<const char*>(&keySize), sizeof(keySize));
-        outFile.write(reinterpret_cast<const char*>(keyBytes.data()), keySize);
+    std::vector<std::thread> threads;
+    const unsigned num_threads = std::max(std::thread::hardware_concurrency(), 1u);
+    for (unsigned t = 0; t < num_threads; ++t) threads.emplace_back(decode);
+    for (auto& thread : threads) thread.join();
 
-        // Serialize mpz_class log
-        std::string logStr = entry.log.get_str(); // Serialize mpz_class as a string
-        size_t logSize = logStr.size();
+    // The chunks have to continue each other, and the high bits must not hold more points than the keys
+    size_t high_points = 0;
+    for (uint64_t word : high) high_points += __builtin_popcountll(word);
+    corrupt = corrupt || high_points != n;
+    for (size_t first = 1ULL << PACKED_CHUNK_BITS; first < n && !corrupt; first += 1ULL << PACKED_CHUNK_BITS) {
+        corrupt = k[first] < k[first - 1];
+    }
 
-        outFile.write(reinterpret_cast<const char*>(&logSize), sizeof(logSize));
-        outFile.write(logStr.c_str(), logSize);
+    if (corrupt) {
+        std::cerr << "Error: Corrupt packed table file: " << path << std::endl;
+        *this = FrozenTable();
+        return false;
     }
 
-    outFile.close();
+    build_index();
     return true;
 }
 
 // Function to read data from a file
-bool TableDataMap::readFromFile(const std::string path) {
-    std::ifstream inFile(path, std::ios::binary);
-    if (!inFile) {
+bool FrozenTable::readFromFile(const std::string path) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
         std::cerr << "Error: Unable to open file for reading: " << path << std::endl;
         return false;
     }
 
-    // Clear the current map
-    tableMap.clear();
-
-    // Read the size of the map
-    size_t mapSize;
-    inFile.read(reinterpret_cast<char*>(&mapSize), sizeof(mapSize));
+    char magic[8] = {};
+    if (pread(fd, magic, sizeof(magic), 0) == sizeof(magic) && std::equal(PACKED_MAGIC, PACKED_MAGIC + 8, magic)) {
+        close(fd);
+        return readPacked(path);
+    }
 
-    // Read each entry in the map
-    for (size_t i = 0; i < mapSize; ++i) {
-        size_t keySize;
-        inFile.read(reinterpret_cast<char*>(&keySize), sizeof(keySize));
-        std::vector<uint8_t> keyBytes(keySize);
-        inFile.read(reinterpret_cast<char*>(keyBytes.data()), keySize);
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t) st.st_size < sizeof(TableFileHeader)) {
+        std::cerr << "Error: Not a table file: " << path << std::endl;
+        close(fd);
+        return false;
+    }
 
-        // Convert the byte array back to a hex string
-        std::string key = bytesToHexString(keyBytes);
+    const size_t size = st.st_size;
+    void* base = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) {
+        std::cerr << "Error: Unable to map table file: " << path << std::endl;
+        return false;
+    }
+    std::shared_ptr<const void> data(base, [size](const void* p) { munmap(const_cast<void*>(p), size); });
 
-        // Deserialize mpz_class log
-        size_t logSize;
-        inFile.read(reinterpret_cast<char*>(&logSize), sizeof(logSize));
-        std::string logStr(logSize, '\0');
-        inFile.read(&logStr[0], logSize);
-        mpz_class log(logStr);
+    // The sections have to lie in the file in order and aligned, with the bucket count a table of count entries gets
+    const TableFileHeader& header = *static_cast<const TableFileHeader*>(base);
+    bool valid = std::equal(TABLE_MAGIC, TABLE_MAGIC + 8, header.magic) && header.version == TABLE_VERSION &&
+                 header.size == size && header.count < size && header.bucket_bits == frozen_bucket_bits(header.count) &&
+                 header.keys_offset == sizeof(TableFileHeader) &&
+                 header.logs_offset == align64(header.keys_offset + header.count * sizeof(uint64_t)) &&
+                 header.offsets_offset == align64(header.logs_offset + header.count * sizeof(int128_t)) &&
+                 header.params_offset ==
+                         align64(header.offsets_offset + ((1ULL << header.bucket_bits) + 1) * sizeof(uint64_t)) &&
+                 header.params_offset <= size;
+    if (!valid || !attach(data, size)) {
+        std::cerr << "Error: Not a version " << TABLE_VERSION << " table file: " << path << std::endl;
+        return false;
+    }
 
-        // Insert the read values into the map
-        tableMap[key] = TableEntryMap{log};
+    // Lookups trust the index: keys have to be sorted, and every bucket's offsets have to frame its keys
+    auto bucket_of = [&](uint64_t key) -> uint64_t { return bucket_bits ? key >> (64 - bucket_bits) : 0; };
+    bool indexed = offsets[0] == 0 && offsets[1ULL << bucket_bits] == count;
+    for (size_t i = 1; i < count && indexed; ++i) indexed = keys[i - 1] <= keys[i];
+    for (size_t b = 0; b < (1ULL << bucket_bits) && indexed; ++b) {
+        const uint64_t first = offsets[b], last = offsets[b + 1];
+        indexed = first <= last && last <= count &&
+                  (first == last || (bucket_of(keys[first]) == b && bucket_of(keys[last - 1]) == b));
+    }
+    if (!indexed) {
+        std::cerr << "Error: Corrupt table file index: " << path << std::endl;
+        *this = FrozenTable();
+        return false;
     }
 
-    inFile.close();
+    // Lookups hit random pages, read ahead would only load pages that are not needed
+    madvise(base, size, MADV_RANDOM);
+
+    mapped = true;
     return true;
 }
+
+namespace {
+    // Input of merge_tables(), read in key order: a table file, mapped or decoded, or a shard file
+    struct MergeInput {
+        std::string path;
+        TableParams params;
+        FrozenTable table;
+        size_t position = 0;
+        std::ifstream shard;
+        uint64_t shard_count = 0;
+        uint64_t remaining = 0;
+
+        void open(const std::string& input) {
+            path = input;
+            char magic[8] = {};
+            std::ifstream(path, std::ios::binary).read(magic, sizeof(magic));
+            if (!std::equal(CHECKPOINT_MAGIC, CHECKPOINT_MAGIC + 8, magic)) {
+                if (!table.readFromFile(path)) throw std::runtime_error("cannot read table file " + path);
+                if (table.mapped) madvise(const_cast<void*>(table.image.get()), table.image_size, MADV_SEQUENTIAL);
+                params = table.params;
+                return;
+            }
+
+            shard.open(path, std::ios::binary);
+            CheckpointFileHeader header = {};
+            shard.read(reinterpret_cast<char*>(&header), sizeof(header));
+            if (!shard || header.version != CHECKPOINT_VERSION || !header.sorted ||
+                header.params_bytes >= (1ULL << 32)) {
+                throw std::runtime_error(path + " is a checkpoint, not a shard file");
+            }
+
+            // The parameters follow the records
+            std::string serialized(header.params_bytes, '\0');
+            shard.seekg(sizeof(header) + header.count * sizeof(CheckpointRecord));
+            shard.read(&serialized[0], serialized.size());
+            if (!shard || !params.parse(serialized.data(), serialized.size())) {
+                throw std::runtime_error("truncated shard file " + path);
+            }
+            shard_count = header.count;
+        }
+
+        void rewind() {
+            position = 0;
+            if (!shard.is_open()) return;
+
+            shard.clear();
+            shard.seekg(sizeof(CheckpointFileHeader));
+            remaining = shard_count;
+        }
+
+        bool next(uint64_t& key, int128_t& log, uint64_t& hits) {
+            if (!shard.is_open()) {
+                if (position == table.size()) return false;
+
+                key = table.keys[position];
+                log = table.logs[position];
+                hits = 1;
+                ++position;
+                return true;
+            }
+
+            if (!remaining) return false;
+
+            CheckpointRecord record;
+            shard.read(reinterpret_cast<char*>(&record), sizeof(record));
+            if (!shard) throw std::runtime_error("truncated shard file " + path);
+            --remaining;
+            key = record.key;
+            log = (int128_t) (((uint128_t) record.log_hi << 64) | record.log_lo);
+            hits = record.hits;
+            return true;
+        }
+    };
+
+    // Calls emit(key, log, hits) for every distinct key of the inputs in order, with the hits summed over the inputs
+    // and the log of the first input that has the key. Returns the number of entries read.
+    template <typename Emit>
+    size_t merge_pass(std::vector<MergeInput>& inputs, Emit emit) {
+        struct Head {
+            uint64_t key;
+            int128_t log;
+            uint64_t hits;
+            size_t input;
+        };
+        auto later = [](const Head& a, const Head& b) { return a.key != b.key ? a.key > b.key : a.input > b.input; };
+        std::priority_queue<Head, std::vector<Head>, decltype(later)> heads(later);
+
+        for (size_t j = 0; j < inputs.size(); ++j) {
+            inputs[j].rewind();
+            Head head = {0, 0, 0, j};
+            if (inputs[j].next(head.key, head.log, head.hits)) heads.push(head);
+        }
+
+        size_t read = 0;
+        while (!heads.empty()) {
+            const Head first = heads.top();
+            uint64_t hits = 0;
+            while (!heads.empty() && heads.top().key == first.key) {
+                Head head = heads.top();
+                heads.pop();
+                hits += head.hits;
+                ++read;
+                if (inputs[head.input].next(head.key, head.log, head.hits)) heads.push(head);
+            }
+            emit(first.key, first.log, hits);
+        }
+        return read;
+    }
+
+    // Inputs of a merge, all of them generated with the parameters of the first one
+    std::vector<MergeInput> open_inputs(const std::vector<std::string>& paths) {
+        if (paths.empty()) throw std::invalid_argument("no tables to merge");
+
+        std::vector<MergeInput> inputs(paths.size());
+        for (size_t j = 0; j < paths.size(); ++j) {
+            inputs[j].open(paths[j]);
+            if (inputs[j].params.serialize() != inputs[0].params.serialize()) {
+                throw std::runtime_error(paths[j] + " was generated with other parameters than " + paths[0]);
+            }
+        }
+        return inputs;
+    }
+}
+
+size_t count_distinct(const std::vector<std::string>& paths) {
+    std::vector<MergeInput> inputs = open_inputs(paths);
+    size_t distinct = 0;
+    merge_pass(inputs, [&](uint64_t, int128_t, uint64_t) { ++distinct; });
+    return distinct;
+}
+
+TableMergeResult merge_tables(const std::vector<std::string>& paths, size_t n, std::string out_path) {
+    if (std::find(paths.begin(), paths.end(), out_path) != paths.end()) {
+        throw std::invalid_argument("the merged table cannot replace one of its inputs");
+    }
+
+    std::vector<MergeInput> inputs = open_inputs(paths);
+
+    // Points by their number of hits, to find the fewest hits a kept point has
+    TableMergeResult result = {};
+    result.read = merge_pass(inputs, [&](uint64_t, int128_t, uint64_t hits) {
+        ++result.by_hits[hits];
+        ++result.distinct;
+    });
+
+    // All points with more than min_hits hits are kept, and the first kept_at_min ones with min_hits
+    for (auto it = result.by_hits.rbegin(); it != result.by_hits.rend() && result.kept < n; ++it) {
+        result.min_hits = it->first;
+        result.kept_at_min = std::min(it->second, n - result.kept);
+        result.kept += result.kept_at_min;
+    }
+
+    // The kept points in key order: all with more than min_hits hits and the first kept_at_min ones with min_hits
+    auto kept_pass = [&](auto emit) {
+        size_t taken = 0, taken_at_min = 0;
+        merge_pass(inputs, [&](uint64_t key, int128_t log, uint64_t hits) {
+            if (taken == result.kept || hits < result.min_hits) return;
+            if (hits == result.min_hits) {
+                if (taken_at_min == result.kept_at_min) return;
+                ++taken_at_min;
+            }
+
+            ++taken;
+            emit(key, log);
+        });
+    };
+
+    // The sections are streamed one after the other, a pass over the inputs each, into a temporary file that replaces
+    // out_path once it is complete and synced
+    const std::string serialized = inputs[0].params.serialize();
+    const TableFileHeader header = table_file_header(result.kept, serialized.size());
+    const std::string temporary = out_path + ".tmp";
+    BlockWriter outFile(temporary);
+    if (!outFile.is_open()) throw std::runtime_error("cannot write table file " + temporary);
+
+    uint64_t position = 0;
+    auto write = [&](const void* data, size_t size) {
+        outFile.write(data, size);
+        position += size;
+    };
+    auto pad_to = [&](uint64_t offset) {
+        const char zeros[64] = {};
+        while (position < offset) write(zeros, std::min<uint64_t>(sizeof(zeros), offset - position));
+    };
+
+    write(&header, sizeof(header));
+    kept_pass([&](uint64_t key, int128_t) { write(&key, sizeof(key)); });
+    pad_to(header.logs_offset);
+    kept_pass([&](uint64_t, int128_t log) { write(&log, sizeof(log)); });
+    pad_to(header.offsets_offset);
+
+    // The offset of a bucket is the number of kept keys in the buckets before it
+    uint64_t bucket = 0, index = 0;
+    kept_pass([&](uint64_t key, int128_t) {
+        const uint64_t key_bucket = header.bucket_bits ? key >> (64 - header.bucket_bits) : 0;
+        for (; bucket <= key_bucket; ++bucket) write(&index, sizeof(index));
+        ++index;
+    });
+    for (; bucket <= (1ULL << header.bucket_bits); ++bucket) write(&index, sizeof(index));
+    pad_to(header.params_offset);
+    write(serialized.data(), serialized.size());
+
+    if (!outFile.close(true) || std::rename(temporary.c_str(), out_path.c_str()) != 0) {
+        std::remove(temporary.c_str());
+        throw std::runtime_error("cannot write table file " + out_path);
+    }
+    return result;
+}